@@ -0,0 +1,31 @@
+	JMP	NC	main
+
+fail:
+	LDW	R0	#xFF
+	INT	END
+
+main:
+	LDW	R0	#x200000	; heap of 64 KiB
+	LDW	R1	#x10000
+	INT	RST
+	LDW	R0	#24
+	INT	ALC				; 32 byte class
+	ADD	R4	R0	#0
+	LDW	R0	#100
+	INT	ALC				; 128 byte class
+	ADD	R5	R0	#0
+	ADD	R0	R4	#0
+	INT	FRE
+	LDW	R0	#20
+	INT	ALC				; reuses the first block
+	CMP	R0	R4
+	JMP	NE	fail
+	ADD	R0	R4	#0
+	INT	FRE
+	ADD	R0	R4	#0
+	INT	FRE				; freeing twice is refused
+	LDW	R1	#0
+	CMP	R0	R1
+	JMP	NE	fail
+	SUB	R0	R5	R4		; 32
+	INT	END
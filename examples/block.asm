@@ -0,0 +1,30 @@
+	JMP	NC	main
+
+main:
+	LDW	R1	#x100000	; device table
+	LDW	R4	#8
+find:
+	LDW	R2	R1	#4
+	LSR	R3	R2	#24
+	LDW	R5	#x11		; block device type
+	CMP	R3	R5
+	JMP	EQ	found
+	ADD	R1	R1	#8
+	DBN	R4	find
+	LDW	R0	#xFF		; no block device configured
+	INT	END
+found:
+	LSL	R2	R2	#8
+	LSR	R2	R2	#8		; window address
+	LDW	R0	#0
+	INT	MAP				; map the start of the file, R0 <- bytes mapped
+	ADD	R6	R0	#0
+	LDB	R3	R2	#0
+	ADD	R3	R3	#1
+	STB	R3	R2	#0		; bump the first byte of the file
+	ADD	R0	R2	#0
+	LDW	R1	#1
+	INT	SYN				; write it back
+	LSL	R0	R3	#16
+	ORR	R0	R0	R6
+	INT	END
@@ -0,0 +1,47 @@
+	JMP	NC	main
+
+fib:
+	LDW	R1	#2
+	CMP	R0	R1
+	JMP	LT	one
+	PSH	R4
+	PSH	R5
+	ADD	R4	R0	#0
+	SUB	R0	R4	#1
+	CAL	fib
+	ADD	R5	R0	#0
+	SUB	R0	R4	#2
+	CAL	fib
+	ADD	R0	R0	R5
+	POP	R5
+	POP	R4
+	RTN
+one:
+	LDW	R0	#1
+	RTN
+
+sum:
+	LDW	R2	#0
+	CMP	R0	R2
+	JMP	EQ	total
+	ADD	R1	R1	R0
+	SUB	R0	R0	#1
+	TCL	sum
+total:
+	ADD	R0	R1	#0
+	RTN
+
+twice:
+	LSL	R0	R0	#1
+	RTN
+
+main:
+	LDW	R0	#20
+	CAL	fib				; 6765
+	ADD	R6	R0	#0
+	LDW	R0	#100
+	LDW	R1	#0
+	CAL	sum				; 5050
+	CAL	twice
+	SUB	R0	R0	R6		; 10100 - 6765
+	INT	END
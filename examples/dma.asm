@@ -0,0 +1,41 @@
+	JMP	NC	main
+
+main:
+	LDW	R1	#x100000	; device table
+	LDW	R4	#8
+find:
+	LDW	R2	R1	#4
+	LSR	R3	R2	#24
+	LDW	R5	#x12		; dma device type
+	CMP	R3	R5
+	JMP	EQ	found
+	ADD	R1	R1	#8
+	DBN	R4	find
+	LDW	R0	#xFF		; no dma device configured
+	INT	END
+found:
+	LSL	R2	R2	#8
+	LSR	R2	R2	#8		; dma registers
+	LDW	R0	#x200000	; source
+	LDW	R1	#x2A
+	LDW	R3	#x10000
+	FIL	R0	R1	R3
+	LDW	R4	#x300000	; destination
+	STR	R0	R2	#0
+	STR	R4	R2	#4
+	STR	R3	R2	#8
+	LDW	R1	#1
+	STR	R1	R2	#16		; start
+	LDW	R6	#3			; busy
+wait:
+	HLT
+	LDW	R5	R2	#16
+	CMP	R5	R6
+	JMP	EQ	wait
+	CPB	R0	R4	R3
+	JMP	NE	fail
+	ADD	R0	R5	#0		; 4 when done
+	INT	END
+fail:
+	LDW	R0	#1
+	INT	END
@@ -0,0 +1,24 @@
+	JMP	NC	main
+
+fail:
+	LDW	R0	#1
+	INT	END
+
+main:
+	LDW	R0	#1.5
+	LDW	R1	#2.25
+	FAD	R2	R0	R1		; 3.75
+	LDW	R3	#4
+	ITF	R3	R3
+	FML	R2	R2	R3		; 15.0
+	LDW	R3	#2.0
+	FDV	R2	R2	R3		; 7.5
+	FSB	R4	R2	R0		; 6.0
+	FCM	R4	R2
+	JMP	GE	fail
+	LDW	R5	#0.0
+	FDV	R5	R5	R5		; NaN
+	FCM	R5	R5
+	JMP	VC	fail
+	FTI	R0	R2			; 7
+	INT	END
@@ -0,0 +1,15 @@
+	JMP	NC	main
+
+leaf:
+	LAR	R0	FP
+	ADD	R0	R0	#x1
+	LDW	R2	R0	#x8
+	ADD	R2	R2	#x1000
+	PSH	R2
+	RET
+
+main:
+	LDW	R3	#5
+	PSH	R3
+	JSR	NC	leaf			; leaves its frame address in R0
+	INT	END
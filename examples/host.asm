@@ -0,0 +1,9 @@
+	JMP	NC	main
+
+main:
+	LDW	R0	#x100100	; "abc"
+	LDW	R1	#x61626300
+	STR	R1	R0	#0
+	LDW	R1	#3
+	INT	#x20			; hash from examples/host.c
+	INT	END
@@ -0,0 +1,20 @@
+#include <stdint.h>
+
+typedef uint32_t word;
+typedef uint8_t byte;
+
+typedef void (*host_function)(word* reg, byte* ram);
+typedef uint8_t (*host_registrar)(byte number, host_function fn, uint16_t reads, uint16_t writes, uint8_t pure);
+
+// R0: address R1: length -> R0: 32 bit FNV-1a hash
+void fnv(word* reg, byte* ram){
+	word hash = 0x811C9DC5;
+	for (word i = 0;i<reg[1];++i){
+		hash = (hash ^ ram[reg[0]+i]) * 0x01000193;
+	}
+	reg[0] = hash;
+}
+
+uint8_t vm_host_init(host_registrar register_host_call){
+	return register_host_call(0x20, fnv, 0x3, 0x1, 1);
+}
@@ -2,7 +2,8 @@
 
 main:
 	LDW	R0	#x4			; setup base heap size
-	STR	R0	&x100040	; choose heap start address
+	LDW	R1	#x100040	; choose heap start address
+	STR	R0	R1	#0
 	
 	LAR	R2	ST
 	LDW	R0	#x100040	; heap base
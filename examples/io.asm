@@ -0,0 +1,78 @@
+	JMP	NC	main
+
+fail:
+	LDW	R0	#xFF
+	INT	END
+
+submit:
+	INT	IOS				; R0: request, result returned in R0
+	LDW	R1	#0
+	CMP	R0	R1
+	JMP	EQ	fail			; rejected
+	LDW	R1	#x100200		; completion ring
+wait:
+	HLT
+	LDW	R2	R1	#0			; head
+	LDW	R3	R1	#4			; tail
+	CMP	R2	R3
+	JMP	EQ	wait
+	LSL	R2	R3	#3
+	ADD	R2	R2	R1
+	LDW	R0	R2	#12			; result of the entry at the tail
+	ADD	R3	R3	#1
+	STR	R3	R1	#4			; consume it
+	RTN
+
+main:
+	LDW	R0	#x100200		; completion ring of 8 entries, no vector
+	LDW	R1	#72
+	LDW	R2	#32
+	INT	IOQ
+	LDW	R4	#x100100		; "Makefile" followed by a terminator
+	LDW	R1	#x4D616B65
+	STR	R1	R4	#0
+	LDW	R1	#x66696C65
+	STR	R1	R4	#4
+	LDW	R1	#0
+	STR	R1	R4	#8
+	LDW	R5	#x100180		; request
+	LDW	R6	#x100300		; buffer
+	STR	R1	R5	#0			; open for reading
+	STR	R1	R5	#4
+	STR	R4	R5	#8
+	STR	R1	R5	#12
+	STR	R1	R5	#16
+	STR	R1	R5	#20
+	ADD	R0	R5	#0
+	CAL	submit
+	LDW	R1	#0
+	CMP	R0	R1
+	JMP	LT	fail
+	ADD	R7	R0	#0			; handle
+	LDW	R1	#1
+	STR	R1	R5	#0			; read the first 8 bytes
+	STR	R7	R5	#4
+	STR	R6	R5	#8
+	LDW	R1	#8
+	STR	R1	R5	#12
+	ADD	R0	R5	#0
+	CAL	submit
+	LDW	R1	#8
+	CMP	R0	R1
+	JMP	NE	fail
+	LDW	R1	#2
+	STR	R1	R5	#0			; write them to stdout
+	LDW	R1	#1
+	STR	R1	R5	#4
+	LDW	R1	#xFFFFFFFF
+	STR	R1	R5	#16
+	ADD	R0	R5	#0
+	CAL	submit
+	ADD	R4	R0	#0			; bytes written
+	LDW	R1	#3
+	STR	R1	R5	#0			; close
+	STR	R7	R5	#4
+	ADD	R0	R5	#0
+	CAL	submit
+	ADD	R0	R4	#0
+	INT	END
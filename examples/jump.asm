@@ -0,0 +1,45 @@
+	JMP	NC	main
+
+bump:
+	LAR	R1	FP
+	ADD	R1	R1	#x1
+	LDW	R2	R1	#x8
+	ADD	R2	R2	#x1000
+	PSH	R2
+	RET
+
+main:
+	LDW	R0	#0
+	LDW	R1	#0
+	LDW	R6	#5
+loop:
+	JTB	R1	#3			; dispatch on R1, past the table when R1 >= 3
+	JTE	inc
+	JTE	dbl
+	JTE	add3
+	ADD	R0	R0	#x100
+	JMP	NC	next
+inc:
+	ADD	R0	R0	#1
+	JMP	NC	next
+dbl:
+	LSL	R0	R0	#1
+	JMP	NC	next
+add3:
+	ADD	R0	R0	#3
+next:
+	ADD	R1	R1	#1
+	DBN	R6	loop
+	LDA	R5	bump
+	PSH	R0
+	JSR	NC	R5			; call through a register
+	POP	R0
+	LDA	R4	skip
+	LAR	PC	R4			; jump by writing PC
+	LDW	R0	#2
+skip:
+	LDA	R4	done
+	JMP	NC	R4
+	LDW	R0	#1
+done:
+	INT	END
@@ -0,0 +1,15 @@
+	JMP	NC	main
+
+main:
+	LDW	R0	#0
+	LDW	R1	#10
+sum:
+	ADD	R0	R0	R1		; 10 + 9 + ... + 1
+	DBN	R1	sum
+	LDW	R2	#40
+	CMP	R0	R2
+	CSL	GT	R3	R0	R2	; R3 <- max(R0, R2)
+	CSL	LT	R4	R0	R2	; R4 <- min(R0, R2)
+	LSL	R3	R3	#8
+	ORR	R0	R3	R4		; 0x3728
+	INT	END
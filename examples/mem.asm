@@ -0,0 +1,15 @@
+	LDW	R0	#x100100	; buffer
+	LDW	R1	#x41		; 'A'
+	LDW	R2	#5
+	FIL	R0	R1	R2		; fill 5 bytes
+	LDW	R1	#xA
+	STB	R1	R0	#5		; newline
+	LDW	R3	#x100101
+	LDW	R2	#6
+	MCP	R3	R0	R2		; overlapping copy one byte forward
+	LDW	R1	#x42
+	STB	R1	R0	#0
+	LDW	R1	#7
+	INT	OUT				; print "BAAAAA\n"
+	LDW	R0	#0
+	INT	END
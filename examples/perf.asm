@@ -0,0 +1,12 @@
+	JMP	NC	main
+
+main:
+	PMC	R4	R5	INS		; R5:R4 <- instructions retired so far
+	LDW	R0	#0
+	LDW	R1	#10
+loop:
+	ADD	R0	R0	#1
+	DBN	R1	loop
+	PMC	R2	R3	INS
+	SUB	R0	R2	R4		; 23 including the second PMC
+	INT	END
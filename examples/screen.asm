@@ -0,0 +1,19 @@
+	JMP	NC	main
+
+main:
+	LDW	R1	#x100000	; first device table entry
+	LDW	R2	R1	#0		; screen size in bytes
+	LDW	R0	R1	#4		; type and address
+	LSL	R0	R0	#8
+	LSR	R0	R0	#8		; strip the type
+	LDW	R3	#0
+draw:
+	STB	R3	R0	R3		; pixel i gets colour i
+	ADD	R3	R3	#1
+	CMP	R3	R2
+	JMP	LT	draw
+	LDW	R5	#x2000000
+hold:
+	DBN	R5	hold		; keep the window up for a moment
+	LDW	R0	#0
+	INT	END
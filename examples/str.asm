@@ -0,0 +1,34 @@
+	JMP	NC	main
+
+fail:
+	LDW	R0	#1
+	INT	END
+
+main:
+	LDW	R0	#x100100	; "abcabc\n" followed by a terminator
+	LDW	R1	#x61626361
+	STR	R1	R0	#0
+	LDW	R1	#x62630A00
+	STR	R1	R0	#4
+	SLN	R2	R0			; string length
+	LDW	R3	#7
+	CMP	R2	R3
+	JMP	NE	fail
+	ADD	R4	R0	#1
+	LDW	R5	#x63		; 'c'
+	SCN	R4	R5	R2		; find the first 'c' after the first byte
+	JMP	NE	fail
+	LDW	R3	#x100102
+	CMP	R4	R3
+	JMP	NE	fail
+	LDW	R5	#3
+	ADD	R6	R0	#3
+	CPB	R0	R6	R5		; "abc" == "abc"
+	JMP	NE	fail
+	LDW	R5	#4
+	CPB	R0	R6	R5		; "abca" > "abc\n"
+	JMP	LE	fail
+	ADD	R1	R2	#0
+	INT	OUT
+	LDW	R0	#0
+	INT	END
@@ -0,0 +1,40 @@
+	JMP	NC	main
+
+tick:
+	ADD	R7	R7	#1		; handlers preserve every register they use
+	IRT
+
+main:
+	LDW	R1	#x100000	; device table
+	LDW	R4	#8
+find:
+	LDW	R2	R1	#4
+	LSR	R3	R2	#24
+	LDW	R5	#x10		; timer device type
+	CMP	R3	R5
+	JMP	EQ	found
+	ADD	R1	R1	#8
+	DBN	R4	find
+	LDW	R0	#xFF		; no timer configured
+	INT	END
+found:
+	LSL	R2	R2	#8
+	LSR	R2	R2	#8		; timer address
+	LDW	R0	#x200000	; vector table
+	LDA	R1	tick
+	STR	R1	R0	#0		; vector 0
+	INT	VEC
+	LDW	R7	#0
+	LDW	R1	#0
+	STR	R1	R2	#4		; raise vector 0
+	LDW	R1	#1000
+	STR	R1	R2	#0		; every millisecond
+	LDW	R6	#5
+wait:
+	HLT
+	CMP	R7	R6
+	JMP	LT	wait
+	LDW	R1	#0
+	STR	R1	R2	#0		; stop the timer
+	LDW	R0	#0
+	INT	END
@@ -0,0 +1,28 @@
+	LDW	R0	#x100100	; buffer
+	LDW	R1	#x40
+	LDW	R2	#16
+	FIL	R0	R1	R2
+	VLD	B	V0	R0
+	LDW	R1	#1
+	VSP	B	V1	R1
+	VAD	B	V2	V0	V1		; sixteen 'A'
+	VST	B	V2	R0
+	LDW	R1	#xA
+	STB	R1	R0	#16
+	LDW	R1	#17
+	INT	OUT
+
+	LDW	R1	#x10003		; words 0x10003 and 0x7
+	STR	R1	R0	#0
+	LDW	R1	#7
+	STR	R1	R0	#4
+	VLD	W	V0	R0
+	LDW	R1	#3
+	VSP	W	V1	R1
+	VML	W	V2	V0	V1
+	VGT	W	V3	V2	V1
+	VAN	W	V2	V2	V3
+	VEX	W	R0	V2	#1		; 21
+	VEX	W	R1	V2	#0		; 0x30009
+	ADD	R0	R0	R1
+	INT	END
@@ -0,0 +1,28 @@
+	JMP	NC	main
+
+fail:
+	LDW	R0	#1
+	INT	END
+
+main:
+	LDW	R0	#xFFFFFFFF	; R1:R0 <- 0x1FFFFFFFF
+	LDW	R1	#1
+	LDW	R2	#1			; R3:R2 <- 0x1
+	LDW	R3	#0
+	ADD	R4	R0	R2		; 64 bit add into R5:R4
+	JMP	CC	fail
+	ADC	R5	R1	R3
+	JMP	CS	fail
+	SUB	R6	R4	#1		; 64 bit subtract of 1 into R7:R6
+	SBC	R7	R5	#0
+	CMP	R6	R0
+	JMP	NE	fail
+	CMP	R7	R1
+	JMP	NE	fail
+	LDW	R0	#x10000
+	MLW	R0	R1	R0	R0	; R1:R0 <- 0x10000 * 0x10000
+	JMP	VC	fail
+	LSL	R1	R1	#4
+	ORR	R0	R0	R1
+	ORR	R0	R0	R5		; 0x12
+	INT	END
@@ -3,9 +3,42 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <dlfcn.h>
+
+// built in device types, usable from device_config
+#define DEV_TIMER 0x10
+#define DEV_BLOCK 0x11
+#define DEV_DMA 0x12
 
 #include <devices.h>
+#ifndef HEADLESS
 #include <SDL2/SDL.h>
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 32
+#define SIMD_ALL 0xFFFFFFFF
+#define SIMD_LOAD(p) _mm256_loadu_si256((const __m256i*)(p))
+#define SIMD_SPLAT(v) _mm256_set1_epi8(v)
+#define SIMD_MATCH(x, y) ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)))
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 16
+#define SIMD_ALL 0xFFFF
+#define SIMD_LOAD(p) _mm_loadu_si128((const __m128i*)(p))
+#define SIMD_SPLAT(v) _mm_set1_epi8(v)
+#define SIMD_MATCH(x, y) ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)))
+#endif
 
 #define DEBUG 0
 
@@ -22,7 +55,7 @@ enum {
 	ST,
 	FP,
 	PC,
-	SR, //-zs- 4th, 1st bit unused for now
+	SR, //---vczsn overflow carry zero greater nonzero
 	REGISTER_COUNT
 };
 
@@ -61,14 +94,80 @@ enum {
 	JMP,//  metric byte | 2 byte label address   |
 	JSR,//  metric byte | 2 byte label address   |
 	RET,//  pop to pc                            |
-	INT//   interrupt   |           |            |
+	INT,//  interrupt   |           |            |
+	LDC,//  00000   dst | 2 byte pool word offset|
+	MCP,//  00000   dst | 00000 src | 00000 len  |
+	FIL,//  00000   dst | 00000 val | 00000 len  |
+	SCN,//  00000   adr | 00000 val | 00000 len  |
+	CPB,//  00000   op1 | 00000 op2 | 00000 len  |
+	SLN,//  00000   dst | 00000 src |            |
+	VLD,//  w   dst     | 00000 adr |            |
+	VST,//  w   src     | 00000 adr |            |
+	VSP,//  w   dst     | 00000 src |            |
+	VEX,//  w   dst src | lane      |            |
+	VAD,//  w   dst op1 | 00000 op2 |            |
+	VSB,//  ...         | ...       |            |
+	VML,//  ...         | ...       |            |
+	VAN,//  ...         | ...       |            |
+	VOR,//  ...         | ...       |            |
+	VXR,//  ...         | ...       |            |
+	VEQ,//  ...         | ...       |            |
+	VGT,//  ...         | ...       |            |
+	ADC,//  0 m dst op1 | 2 byte int or reg op2  |
+	SBC,//  ...         | ...                    |
+	MLW,//  00  dst op1 | 00000 op2 | 00000 hi   |
+	FAD,//  00000   dst | 00000 op1 | 00000 op2  |
+	FSB,//  ...         | ...       | ...        |
+	FML,//  ...         | ...       | ...        |
+	FDV,//  ...         | ...       | ...        |
+	FCM,//  00000   op1 | 00000 op2 |            |
+	ITF,//  00000   dst | 00000 src |            |
+	FTI,//  00000   dst | 00000 src |            |
+	DBN,//  00000   reg | 2 byte label address   |
+	CSL,//  0 dst metric| 00000 op1 | 00000 op2  |
+	LDA,//  00000   dst | 2 byte label address   |
+	JTB,//  00000   reg | 2 byte entry count     |
+	JTE,//  00000000    | 2 byte label address   |
+	CAL,//  i0000000    | 2 byte label address   |
+	RTN,//              |           |            |
+	PMC,//  00   lo  hi | counter   |            |
+	HLT,//              |           |            |
+	IRT //              |           |            |
+};
+
+// vector registers
+enum {
+	V0=0,
+	V1,
+	V2,
+	V3,
+	V4,
+	V5,
+	V6,
+	V7,
+	VREGISTER_COUNT
+};
+
+// vector lane widths
+enum {
+	B=0,
+	H,
+	W
 };
 
 // system interrupts
 enum {
 	END=0,
 	KBD,
-	OUT // R0: str R1: len
+	OUT,// R0: str R1: len
+	VEC,// R0: vector table address
+	MAP,// R0: block window index
+	SYN,// R0: address R1: len
+	IOS,// R0: request address
+	IOQ,// R0: ring address R1: ring size R2: vector
+	ALC,// R0: size
+	FRE,// R0: address
+	RST // R0: heap address R1: heap size
 };
 
 // comparison metrics
@@ -79,7 +178,21 @@ enum {
 	LT,
 	GT,
 	LE,
-	GE
+	GE,
+	CS,
+	CC,
+	VS,
+	VC
+};
+
+// performance counters
+enum {
+	INS=0, // retired instructions, always counted
+	LDS,   // loads
+	STS,   // stores
+	BRN,   // taken branches
+	IRQ,   // interrupts
+	COUNTER_COUNT
 };
 
 typedef uint8_t byte;
@@ -101,27 +214,52 @@ typedef struct label_assoc{
 /* Device layout
  * Device Size (Word)
  * Device Type (Byte)
- * Device Pointer (3 Bytes)
+ * Device Pointer (3 Bytes), so every device must start below DEV_POINTER
+ * A block device window is 16 MiB, so nothing can be configured after it
  */
+#define DEV_POINTER 0x1000000
 #define DEV_END	(DEV_COUNT*DEV_SIZE)+PROG_END
 #define RAM_START DEV_END
 #define RAM_SIZE 0xA00000
 #define RAM_END RAM_START+RAM_SIZE
 #define DEV_MEM 0x4000000
 #define MEM_SIZE RAM_END+DEV_MEM
+#define POOL_SIZE 0x10000
+#define POOL_GUARD 2
+
+typedef uint8_t vec8 __attribute__((vector_size(16)));
+typedef uint16_t vec16 __attribute__((vector_size(16)));
+typedef uint32_t vec32 __attribute__((vector_size(16)));
+
+typedef union vector{
+	vec8 b;
+	vec16 h;
+	vec32 w;
+}vector;
 
 static word reg[REGISTER_COUNT];
+static vector vreg[VREGISTER_COUNT];
 static byte ram[MEM_SIZE];
+static uint64_t counters[COUNTER_COUNT];
+
+#ifdef PERF_COUNTERS
+#define COUNT_EVENT(c) counters[c] += 1;
+#else
+#define COUNT_EVENT(c)
+#endif
 
+#define INDIRECT 0x80
 #define NEXT ram[reg[PC]++]
 #define LOAD ((NEXT<<8) + (NEXT))
 #define READ(addr) ((ram[addr]<<8) + (ram[addr+1]))
-#define WRITE(addr, val)\
-	ram[addr] = (val>>24) & (0xFF);\
-	ram[addr+1] = (val>>16) & (0xFF);\
-	ram[addr+2] = (val>>8) & (0xFF);\
-	ram[addr+3] = (val) & (0xFF);\
+#define READ_WORD(addr) ((ram[addr]<<24) | (ram[(addr)+1]<<16) | (ram[(addr)+2]<<8) | ram[(addr)+3])
+#define WRITE_BYTES(dst, addr, val)\
+	dst[addr] = (val>>24) & (0xFF);\
+	dst[addr+1] = (val>>16) & (0xFF);\
+	dst[addr+2] = (val>>8) & (0xFF);\
+	dst[addr+3] = (val) & (0xFF);\
 
+#define WRITE(addr, val) WRITE_BYTES(ram, addr, val)
 
 #define LOAD_WORD(r, addr)\
 	reg[r] = ((ram[addr] << 24)\
@@ -129,6 +267,649 @@ static byte ram[MEM_SIZE];
            | (ram[addr+2] << 8)\
            | (ram[addr+3]));\
 
+word region_end(word address){
+	word bounds[] = {PROG_ADDRESS, PROG_END, DEV_END, RAM_END, MEM_SIZE};
+	for (uint8_t i = 1;i<sizeof(bounds)/sizeof(word);++i){
+		if (address < bounds[i]){
+			return address >= bounds[i-1] ? bounds[i] : 0;
+		}
+	}
+	return 0;
+}
+
+uint8_t memory_range(word address, word len){
+	word end = region_end(address);
+	return end != 0 && len <= end-address;
+}
+
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t event_signal = PTHREAD_COND_INITIALIZER;
+static uint64_t event_count;
+static uint64_t events_seen;
+static atomic_uint event_sources;
+
+void signal_event(){
+	pthread_mutex_lock(&event_lock);
+	event_count += 1;
+	pthread_cond_broadcast(&event_signal);
+	pthread_mutex_unlock(&event_lock);
+}
+
+void remove_event_source(){
+	atomic_fetch_sub(&event_sources, 1);
+	signal_event();
+}
+
+void wait_for_event(){
+	pthread_mutex_lock(&event_lock);
+	while (event_count == events_seen && atomic_load(&event_sources) != 0){
+		pthread_cond_wait(&event_signal, &event_lock);
+	}
+	events_seen = event_count;
+	pthread_mutex_unlock(&event_lock);
+}
+
+#define VECTOR_COUNT 32
+
+static atomic_uint pending_interrupts;
+static word vector_base;
+static uint8_t in_interrupt;
+
+void raise_interrupt(byte vector){
+	atomic_fetch_or(&pending_interrupts, 1u << (vector % VECTOR_COUNT));
+	signal_event();
+}
+
+typedef struct device{
+	byte type;
+	word start;
+	word size;
+	word width;
+	word height;
+	atomic_uchar* dirty;
+}device;
+
+static device devices[DEV_COUNT];
+static size_t device_count;
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_signal = PTHREAD_COND_INITIALIZER;
+static word timer_period;
+static byte timer_vector;
+
+/* DMA layout
+ * Source address (Word)
+ * Destination address (Word)
+ * Length (Word)
+ * Vector raised on completion (Word)
+ * Control (Word), DMA_START or DMA_START_IRQ from the program, then DMA_BUSY and DMA_DONE or DMA_FAILED from the host
+ */
+#define DMA_SIZE 20
+enum {
+	DMA_IDLE=0,
+	DMA_START,
+	DMA_START_IRQ,
+	DMA_BUSY,
+	DMA_DONE,
+	DMA_FAILED
+};
+
+typedef struct dma_transfer{
+	device* dev;
+	word src;
+	word dst;
+	word len;
+	byte vector;
+	uint8_t interrupt;
+}dma_transfer;
+
+static pthread_mutex_t dma_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dma_signal = PTHREAD_COND_INITIALIZER;
+static dma_transfer dma_job;
+static uint8_t dma_pending;
+
+void program_dma(device* dev){
+	byte* base = ram+dev->start;
+	byte control = __atomic_load_n(base+19, __ATOMIC_RELAXED);
+	if (control != DMA_START && control != DMA_START_IRQ){
+		return;
+	}
+	pthread_mutex_lock(&dma_lock);
+	if (dma_pending){
+		pthread_mutex_unlock(&dma_lock);
+		return;
+	}
+	dma_job.dev = dev;
+	dma_job.src = (base[0]<<24) | (base[1]<<16) | (base[2]<<8) | base[3];
+	dma_job.dst = (base[4]<<24) | (base[5]<<16) | (base[6]<<8) | base[7];
+	dma_job.len = (base[8]<<24) | (base[9]<<16) | (base[10]<<8) | base[11];
+	dma_job.vector = base[15];
+	dma_job.interrupt = (control == DMA_START_IRQ);
+	dma_pending = 1;
+	__atomic_store_n(base+19, DMA_BUSY, __ATOMIC_RELAXED);
+	atomic_fetch_add(&event_sources, 1);
+	pthread_cond_signal(&dma_signal);
+	pthread_mutex_unlock(&dma_lock);
+}
+
+void mark_dirty(word address, word len){
+	for (size_t i = 0;i<device_count;++i){
+		device* dev = &devices[i];
+		if (dev->dirty == NULL || address >= dev->start+dev->size || address+len <= dev->start){
+			continue;
+		}
+		word first = (address < dev->start) ? 0 : address-dev->start;
+		word last = address+len-dev->start;
+		if (last > dev->size){
+			last = dev->size;
+		}
+		for (word row = first/dev->width;row <= (last-1)/dev->width;++row){
+			atomic_store_explicit(&dev->dirty[row], 1, memory_order_release);
+		}
+	}
+}
+
+void device_write(word address, word len){
+	mark_dirty(address, len);
+	for (size_t i = 0;i<device_count;++i){
+		device* dev = &devices[i];
+		if (address >= dev->start+dev->size || address+len <= dev->start){
+			continue;
+		}
+		if (dev->type == DEV_TIMER){
+			byte* base = ram+dev->start;
+			pthread_mutex_lock(&timer_lock);
+			timer_period = (base[0]<<24) | (base[1]<<16) | (base[2]<<8) | base[3];
+			timer_vector = base[7];
+			pthread_cond_signal(&timer_signal);
+			pthread_mutex_unlock(&timer_lock);
+		}
+		else if (dev->type == DEV_DMA){
+			program_dma(dev);
+		}
+	}
+}
+
+#define DEVICE_WRITE(addr, len)\
+	if ((addr) >= RAM_END){\
+		device_write(addr, len);\
+	}\
+
+#define RING_HEADER 8
+#define MOUSE_EVENTS 64
+#define TIMER_SIZE 8
+#define BLOCK_WINDOW 0x1000000
+
+/* Input ring layout
+ * Head index (Word), advanced by the host
+ * Tail index (Word), advanced by the program
+ * Events (Word each)
+ */
+word ring_capacity(device* dev){
+	word capacity = (dev->size < RING_HEADER) ? 0 : (dev->size-RING_HEADER)/4;
+	return (capacity > 0x100) ? 0x100 : capacity;
+}
+
+void ring_push(device* dev, word event){
+	word capacity = ring_capacity(dev);
+	byte* base = ram+dev->start;
+	if (capacity < 2){
+		return;
+	}
+	byte head = __atomic_load_n(base+3, __ATOMIC_RELAXED);
+	byte tail = __atomic_load_n(base+7, __ATOMIC_ACQUIRE);
+	if ((head+1) % capacity == tail){
+		return;
+	}
+	WRITE_BYTES(base, RING_HEADER+(head*4), event)
+	__atomic_store_n(base+3, (head+1) % capacity, __ATOMIC_RELEASE);
+	signal_event();
+}
+
+word ring_pop(device* dev){
+	word capacity = ring_capacity(dev);
+	byte* base = ram+dev->start;
+	if (capacity < 2){
+		return 0;
+	}
+	byte head = __atomic_load_n(base+3, __ATOMIC_ACQUIRE);
+	byte tail = base[7];
+	if (head == tail){
+		return 0;
+	}
+	byte* entry = base+RING_HEADER+(tail*4);
+	word event = (entry[0]<<24) | (entry[1]<<16) | (entry[2]<<8) | entry[3];
+	__atomic_store_n(base+7, (tail+1) % capacity, __ATOMIC_RELEASE);
+	return event;
+}
+
+static int block_fd = -1;
+static device* block_device;
+static uintptr_t host_page;
+
+word map_block(word window){
+	byte* base = ram+block_device->start;
+	if (mmap(base, BLOCK_WINDOW, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_PRIVATE | MAP_ANONYMOUS, -1, 0) == MAP_FAILED){
+		return 0;
+	}
+	struct stat info;
+	if (block_fd < 0 || fstat(block_fd, &info) != 0){
+		return 0;
+	}
+	off_t offset = (off_t)window*BLOCK_WINDOW;
+	if (offset >= info.st_size){
+		return 0;
+	}
+	word len = (info.st_size-offset < BLOCK_WINDOW) ? info.st_size-offset : BLOCK_WINDOW;
+	if (mmap(base, len, PROT_READ | PROT_WRITE, MAP_FIXED | MAP_SHARED, block_fd, offset) == MAP_FAILED){
+		return 0;
+	}
+	return len;
+}
+
+uint8_t sync_block(word address, word len){
+	if (block_device == NULL || address < block_device->start || address+len > block_device->start+BLOCK_WINDOW || address+len < address){
+		return 0;
+	}
+	byte* aligned = (byte*)((uintptr_t)(ram+address) & ~(host_page-1));
+	return msync(aligned, (ram+address+len)-aligned, MS_SYNC) == 0;
+}
+
+#define FILE_COUNT 16
+#define IO_THREADS 4
+#define IO_QUEUE 0x100
+#define IO_REQUEST_SIZE 24
+#define IO_STREAM 0xFFFFFFFF
+#define STANDARD_FILES 3
+
+/* I/O request layout
+ * Operation (Word)
+ * Handle, or the open mode for IO_OPEN (Word)
+ * Buffer address, or the zero terminated path for IO_OPEN (Word)
+ * Length (Word)
+ * File offset (Word), IO_STREAM for the current position
+ * Tag copied to the completion (Word)
+ *
+ * I/O completion layout
+ * Tag (Word)
+ * Result (Word), bytes transferred or the new handle, negative errno on failure
+ */
+enum {
+	IO_OPEN=0,
+	IO_READ,
+	IO_WRITE,
+	IO_CLOSE
+};
+
+enum {
+	OPEN_READ=0,
+	OPEN_WRITE,
+	OPEN_APPEND,
+	OPEN_UPDATE
+};
+
+typedef struct io_request{
+	word op;
+	word handle;
+	word buffer;
+	word len;
+	word offset;
+	word tag;
+}io_request;
+
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t io_signal = PTHREAD_COND_INITIALIZER;
+static io_request io_queue[IO_QUEUE];
+static size_t io_first;
+static size_t io_queued;
+static word io_in_flight;
+static word completion_ring;
+static word completion_size;
+static byte completion_vector;
+static uint8_t io_running;
+static pthread_t io_threads[IO_THREADS];
+
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
+static int files[FILE_COUNT] = {0, 1, 2, [3 ... FILE_COUNT-1] = -1};
+
+word open_file(io_request* req){
+	word end = region_end(req->buffer);
+	if (end == 0 || strnlen((char*)ram+req->buffer, end-req->buffer) == end-req->buffer){
+		return -EINVAL;
+	}
+	int flags = O_RDONLY;
+	switch (req->handle){
+	case OPEN_READ: flags = O_RDONLY; break;
+	case OPEN_WRITE: flags = O_WRONLY | O_CREAT | O_TRUNC; break;
+	case OPEN_APPEND: flags = O_WRONLY | O_CREAT | O_APPEND; break;
+	case OPEN_UPDATE: flags = O_RDWR | O_CREAT; break;
+	default: return -EINVAL;
+	}
+	int fd = open((char*)ram+req->buffer, flags, 0644);
+	if (fd < 0){
+		return -errno;
+	}
+	pthread_mutex_lock(&files_lock);
+	for (word handle = 0;handle<FILE_COUNT;++handle){
+		if (files[handle] < 0){
+			files[handle] = fd;
+			pthread_mutex_unlock(&files_lock);
+			return handle;
+		}
+	}
+	pthread_mutex_unlock(&files_lock);
+	close(fd);
+	return -EMFILE;
+}
+
+word perform_io(io_request* req){
+	if (req->op == IO_OPEN){
+		return open_file(req);
+	}
+	if (req->handle >= FILE_COUNT){
+		return -EBADF;
+	}
+	if (req->op == IO_CLOSE && req->handle < STANDARD_FILES){
+		return -EPERM;
+	}
+	pthread_mutex_lock(&files_lock);
+	int fd = files[req->handle];
+	if (req->op == IO_CLOSE){
+		files[req->handle] = -1;
+	}
+	pthread_mutex_unlock(&files_lock);
+	if (fd < 0){
+		return -EBADF;
+	}
+	ssize_t n = 0;
+	switch (req->op){
+	case IO_CLOSE:
+		return (close(fd) == 0) ? 0 : -errno;
+	case IO_READ:
+		if (!memory_range(req->buffer, req->len)){
+			return -EFAULT;
+		}
+		n = (req->offset == IO_STREAM)
+			? read(fd, ram+req->buffer, req->len)
+			: pread(fd, ram+req->buffer, req->len, req->offset);
+		if (n > 0){
+			mark_dirty(req->buffer, n);
+		}
+		break;
+	case IO_WRITE:
+		if (!memory_range(req->buffer, req->len)){
+			return -EFAULT;
+		}
+		n = (req->offset == IO_STREAM)
+			? write(fd, ram+req->buffer, req->len)
+			: pwrite(fd, ram+req->buffer, req->len, req->offset);
+		break;
+	default:
+		return -EINVAL;
+	}
+	return (n < 0) ? -errno : n;
+}
+
+word completion_capacity(){
+	word capacity = (completion_size < RING_HEADER) ? 0 : (completion_size-RING_HEADER)/8;
+	return (capacity > 0x100) ? 0x100 : capacity;
+}
+
+void complete_io(word tag, word result){
+	byte* base = ram+completion_ring;
+	byte head = base[3];
+	byte* entry = base+RING_HEADER+(head*8);
+	WRITE_BYTES(entry, 0, tag)
+	WRITE_BYTES(entry, 4, result)
+	__atomic_store_n(base+3, (head+1) % completion_capacity(), __ATOMIC_RELEASE);
+	io_in_flight -= 1;
+	if (completion_vector < VECTOR_COUNT){
+		raise_interrupt(completion_vector);
+	}
+	remove_event_source();
+}
+
+void* run_io(void* arg){
+	pthread_mutex_lock(&io_lock);
+	while (io_running){
+		if (io_queued == 0){
+			pthread_cond_wait(&io_signal, &io_lock);
+			continue;
+		}
+		io_request req = io_queue[io_first];
+		io_first = (io_first+1) % IO_QUEUE;
+		io_queued -= 1;
+		pthread_mutex_unlock(&io_lock);
+		word result = perform_io(&req);
+		pthread_mutex_lock(&io_lock);
+		complete_io(req.tag, result);
+	}
+	pthread_mutex_unlock(&io_lock);
+	return NULL;
+}
+
+uint8_t submit_io(word address){
+	if (!memory_range(address, IO_REQUEST_SIZE)){
+		return 0;
+	}
+	pthread_mutex_lock(&io_lock);
+	word capacity = completion_capacity();
+	byte* base = ram+completion_ring;
+	word used = (capacity == 0) ? 0 : (base[3]+capacity-__atomic_load_n(base+7, __ATOMIC_RELAXED)) % capacity;
+	if (capacity < 2 || io_in_flight+used >= capacity-1 || io_queued == IO_QUEUE){
+		pthread_mutex_unlock(&io_lock);
+		return 0;
+	}
+	if (!io_running){
+		io_running = 1;
+		for (size_t i = 0;i<IO_THREADS;++i){
+			pthread_create(&io_threads[i], NULL, run_io, NULL);
+		}
+	}
+	io_request* req = &io_queue[(io_first+io_queued) % IO_QUEUE];
+	req->op = READ_WORD(address);
+	req->handle = READ_WORD(address+4);
+	req->buffer = READ_WORD(address+8);
+	req->len = READ_WORD(address+12);
+	req->offset = READ_WORD(address+16);
+	req->tag = READ_WORD(address+20);
+	io_queued += 1;
+	io_in_flight += 1;
+	atomic_fetch_add(&event_sources, 1);
+	pthread_cond_signal(&io_signal);
+	pthread_mutex_unlock(&io_lock);
+	return 1;
+}
+
+uint8_t set_completion_ring(word address, word size, byte vector){
+	if (!memory_range(address, size)){
+		return 0;
+	}
+	pthread_mutex_lock(&io_lock);
+	if (io_in_flight != 0){
+		pthread_mutex_unlock(&io_lock);
+		return 0;
+	}
+	completion_ring = address;
+	completion_size = size;
+	completion_vector = vector;
+	memset(ram+address, 0, RING_HEADER);
+	pthread_mutex_unlock(&io_lock);
+	return 1;
+}
+
+void stop_io(){
+	pthread_mutex_lock(&io_lock);
+	uint8_t running = io_running;
+	io_running = 0;
+	pthread_cond_broadcast(&io_signal);
+	pthread_mutex_unlock(&io_lock);
+	for (size_t i = 0;running && i<IO_THREADS;++i){
+		pthread_join(io_threads[i], NULL);
+	}
+}
+
+#define HOST_CALL_BASE 0x20
+#define HOST_CALL_COUNT (0x100-HOST_CALL_BASE)
+#define HOST_CALL_REGISTERS 0xFF
+
+/* Native services behind INT numbers from HOST_CALL_BASE up.
+ * reads and writes are register masks, bit n for register n.
+ * A pure call only reads and writes the registers it declares and skips the
+ * register save around the interrupt, so it may only write R0 to R7.
+ */
+typedef void (*host_function)(word* reg, byte* ram);
+typedef uint8_t (*host_registrar)(byte number, host_function fn, uint16_t reads, uint16_t writes, uint8_t pure);
+
+typedef struct host_call{
+	host_function fn;
+	uint16_t reads;
+	uint16_t writes;
+	uint8_t pure;
+}host_call;
+
+static host_call host_calls[HOST_CALL_COUNT];
+
+uint8_t register_host_call(byte number, host_function fn, uint16_t reads, uint16_t writes, uint8_t pure){
+	if (number < HOST_CALL_BASE || fn == NULL || host_calls[number-HOST_CALL_BASE].fn != NULL){
+		return 0;
+	}
+	if (pure && (writes & ~HOST_CALL_REGISTERS)){
+		return 0;
+	}
+	host_call* call = &host_calls[number-HOST_CALL_BASE];
+	call->fn = fn;
+	call->reads = reads;
+	call->writes = writes;
+	call->pure = pure;
+	return 1;
+}
+
+host_call* find_host_call(byte number){
+	if (number < HOST_CALL_BASE || host_calls[number-HOST_CALL_BASE].fn == NULL){
+		return NULL;
+	}
+	return &host_calls[number-HOST_CALL_BASE];
+}
+
+uint8_t load_host_calls(char* path){
+	void* lib = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+	if (lib == NULL){
+		fprintf(stderr, "%s\n", dlerror());
+		return 0;
+	}
+	uint8_t (*init)(host_registrar) = (uint8_t (*)(host_registrar))dlsym(lib, "vm_host_init");
+	if (init == NULL){
+		fprintf(stderr, "%s\n", dlerror());
+		dlclose(lib);
+		return 0;
+	}
+	return init(register_host_call);
+}
+
+#define HEAP_GRANULE 16
+#define HEAP_CLASSES 8
+#define HEAP_FREED 0x80000000
+
+/* Allocations are made in granules of HEAP_GRANULE bytes.
+ * Sizes up to 2^(HEAP_CLASSES-1) granules round up to a power of two class
+ * with its own free list, larger ones share the last list and are reused first fit.
+ * heap_sizes holds the granule count of the allocation starting at each granule,
+ * so the guest heap itself carries no headers.
+ */
+typedef struct free_list{
+	word* addresses;
+	size_t count;
+	size_t capacity;
+}free_list;
+
+static word heap_base;
+static word heap_top;
+static word heap_end;
+static word* heap_sizes;
+static free_list heap_free[HEAP_CLASSES+1];
+
+byte heap_class(word granules){
+	byte class = 0;
+	while (class < HEAP_CLASSES && (1u<<class) < granules){
+		++class;
+	}
+	return class;
+}
+
+uint8_t reset_heap(word address, word size){
+	word base = (address+HEAP_GRANULE-1) & ~(HEAP_GRANULE-1);
+	if (region_end(address) != RAM_END || !memory_range(address, size) || size < base-address+HEAP_GRANULE){
+		return 0;
+	}
+	free(heap_sizes);
+	heap_base = base;
+	heap_top = base;
+	heap_end = base+((size-(base-address)) & ~(HEAP_GRANULE-1));
+	heap_sizes = calloc((heap_end-heap_base)/HEAP_GRANULE, sizeof(word));
+	for (size_t i = 0;i<=HEAP_CLASSES;++i){
+		heap_free[i].count = 0;
+	}
+	return heap_sizes != NULL;
+}
+
+word allocate(word size){
+	if (heap_sizes == NULL || size == 0 || size > heap_end-heap_base){
+		return 0;
+	}
+	word granules = (size+HEAP_GRANULE-1)/HEAP_GRANULE;
+	byte class = heap_class(granules);
+	free_list* list = &heap_free[class];
+	if (class < HEAP_CLASSES){
+		granules = 1<<class;
+		if (list->count != 0){
+			word address = list->addresses[--list->count];
+			heap_sizes[(address-heap_base)/HEAP_GRANULE] &= ~HEAP_FREED;
+			return address;
+		}
+	}
+	else {
+		for (size_t i = 0;i<list->count;++i){
+			word address = list->addresses[i];
+			word* entry = &heap_sizes[(address-heap_base)/HEAP_GRANULE];
+			if ((*entry & ~HEAP_FREED) >= granules){
+				list->addresses[i] = list->addresses[--list->count];
+				*entry &= ~HEAP_FREED;
+				return address;
+			}
+		}
+	}
+	if (heap_end-heap_top < granules*HEAP_GRANULE){
+		return 0;
+	}
+	word address = heap_top;
+	heap_top += granules*HEAP_GRANULE;
+	heap_sizes[(address-heap_base)/HEAP_GRANULE] = granules;
+	return address;
+}
+
+uint8_t release(word address){
+	if (heap_sizes == NULL || address < heap_base || address >= heap_top || (address-heap_base) % HEAP_GRANULE != 0){
+		return 0;
+	}
+	word* entry = &heap_sizes[(address-heap_base)/HEAP_GRANULE];
+	if (*entry == 0 || (*entry & HEAP_FREED)){
+		return 0;
+	}
+	free_list* list = &heap_free[heap_class(*entry)];
+	if (list->count == list->capacity){
+		size_t capacity = list->capacity == 0 ? 0x40 : list->capacity*2;
+		word* addresses = realloc(list->addresses, capacity*sizeof(word));
+		if (addresses == NULL){
+			return 0;
+		}
+		list->addresses = addresses;
+		list->capacity = capacity;
+	}
+	list->addresses[list->count++] = address;
+	*entry |= HEAP_FREED;
+	return 1;
+}
 
 void stack_push(word value){
 	for (uint8_t i = 0;i<4;++i){
@@ -179,6 +960,13 @@ void handle_interrupt(byte intr){
 #if (DEBUG==1)
 		printf("KBD\n");
 #endif
+		reg[R0] = 0;
+		for (size_t i = 0;i<device_count;++i){
+			if (devices[i].type == DEV_KEYBOARD){
+				reg[R0] = ring_pop(&devices[i]);
+				break;
+			}
+		}
 		break;
 	case OUT:
 #if (DEBUG==1)
@@ -186,6 +974,59 @@ void handle_interrupt(byte intr){
 #endif
 		to_stdout();
 		break;
+	case VEC:
+#if (DEBUG==1)
+		printf("VEC\n");
+#endif
+		vector_base = reg[R0];
+		break;
+	case MAP:
+#if (DEBUG==1)
+		printf("MAP\n");
+#endif
+		reg[R0] = (block_device == NULL) ? 0 : map_block(reg[R0]);
+		break;
+	case SYN:
+#if (DEBUG==1)
+		printf("SYN\n");
+#endif
+		reg[R0] = sync_block(reg[R0], reg[R1]);
+		break;
+	case IOS:
+#if (DEBUG==1)
+		printf("IOS\n");
+#endif
+		reg[R0] = submit_io(reg[R0]);
+		break;
+	case IOQ:
+#if (DEBUG==1)
+		printf("IOQ\n");
+#endif
+		reg[R0] = set_completion_ring(reg[R0], reg[R1], reg[R2]);
+		break;
+	case ALC:
+#if (DEBUG==1)
+		printf("ALC\n");
+#endif
+		reg[R0] = allocate(reg[R0]);
+		break;
+	case FRE:
+#if (DEBUG==1)
+		printf("FRE\n");
+#endif
+		reg[R0] = release(reg[R0]);
+		break;
+	case RST:
+#if (DEBUG==1)
+		printf("RST\n");
+#endif
+		reg[R0] = reset_heap(reg[R0], reg[R1]);
+		break;
+	default:
+		if (find_host_call(intr) != NULL){
+			find_host_call(intr)->fn(reg, ram);
+		}
+		break;
 	}
 	for (size_t i = REGISTER_COUNT-1;i>=PC;--i){
 		reg[i] = stack_pop();
@@ -205,25 +1046,130 @@ uint8_t check_metric(byte metric){
 	case LT: return !(reg[SR] & (1<<1));
 	case GT: return reg[SR] & (1<<1);
 	case LE: return (!(reg[SR] & (1<<1))) | (reg[SR] & (1<<2));
-	case GE: return reg[SR];
+	case GE: return reg[SR] & 0x7;
+	case CS: return reg[SR] & (1<<3);
+	case CC: return !(reg[SR] & (1<<3));
+	case VS: return reg[SR] & (1<<4);
+	case VC: return !(reg[SR] & (1<<4));
 	}
 	return 0;
 }
 
-void set_status(word val){
-	reg[SR] = ((val==0) << 2)
-			| (val > 0)
-			| (0);
+word scan_byte(byte* p, word len, byte value){
+	word i = 0;
+#ifdef SIMD_WIDTH
+	for (;i+SIMD_WIDTH<=len;i+=SIMD_WIDTH){
+		uint32_t mask = SIMD_MATCH(SIMD_LOAD(p+i), SIMD_SPLAT(value));
+		if (mask){
+			return i+__builtin_ctz(mask);
+		}
+	}
+#endif
+	for (;i<len;++i){
+		if (p[i] == value){
+			return i;
+		}
+	}
+	return len;
 }
 
-void progress(){
-	byte a, b, m, src, dst, op1, op2;
-	int32_t offset, src_val, x, y;
-	word src_address, dst_address, preserve;
-	byte opcode = NEXT;
-	switch (opcode){
-	case LDW:
-		a = NEXT;
+word compare_bytes(byte* a, byte* b, word len){
+	word i = 0;
+#ifdef SIMD_WIDTH
+	for (;i+SIMD_WIDTH<=len;i+=SIMD_WIDTH){
+		uint32_t mask = SIMD_MATCH(SIMD_LOAD(a+i), SIMD_LOAD(b+i));
+		if (mask != SIMD_ALL){
+			return i+__builtin_ctz(~mask);
+		}
+	}
+#endif
+	for (;i<len;++i){
+		if (a[i] != b[i]){
+			return i;
+		}
+	}
+	return len;
+}
+
+vector swap_lanes(vector v, byte width){
+	const vec8 half = {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14};
+	const vec8 full = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12};
+	switch (width){
+	case H:
+		v.b = __builtin_shuffle(v.b, half);
+		break;
+	case W:
+		v.b = __builtin_shuffle(v.b, full);
+		break;
+	}
+	return v;
+}
+
+#define VECTOR_OP(expr)\
+	a = NEXT;\
+	m = (a>>6) & 0x3;\
+	dst = (a>>3) & 0x7;\
+	op1 = a & 0x7;\
+	op2 = NEXT & 0x7;\
+	NEXT;\
+	switch (m){\
+	case B: vreg[dst].b = (vec8)(vreg[op1].b expr vreg[op2].b); break;\
+	case H: vreg[dst].h = (vec16)(vreg[op1].h expr vreg[op2].h); break;\
+	case W: vreg[dst].w = (vec32)(vreg[op1].w expr vreg[op2].w); break;\
+	}\
+
+float as_float(word val){
+	float f;
+	memcpy(&f, &val, sizeof(float));
+	return f;
+}
+
+word from_float(float f){
+	word val;
+	memcpy(&val, &f, sizeof(float));
+	return val;
+}
+
+int32_t float_to_int(float f){
+	if (isnan(f)){
+		return 0;
+	}
+	if (f >= 2147483648.0f){
+		return INT32_MAX;
+	}
+	if (f < -2147483648.0f){
+		return INT32_MIN;
+	}
+	return f;
+}
+
+#define FLOAT_OP(expr)\
+	dst = NEXT & 0x7;\
+	op1 = NEXT & 0x7;\
+	op2 = NEXT & 0x7;\
+	reg[dst] = from_float(as_float(reg[op1]) expr as_float(reg[op2]));\
+
+void set_status(word val){
+	reg[SR] = ((val==0) << 2)
+			| (val > 0)
+			| (0);
+}
+
+void set_arithmetic_status(word val, uint64_t wide, word overflow){
+	set_status(val);
+	reg[SR] |= (((wide >> 32) != 0) << 3)
+			 | ((overflow >> 31) << 4);
+}
+
+void progress(){
+	byte a, b, m, src, dst, op1, op2;
+	int32_t src_val, x, y;
+	word offset, src_address, dst_address, preserve;
+	uint64_t wide;
+	byte opcode = NEXT;
+	switch (opcode){
+	case LDW:
+		a = NEXT;
 		m = (a>>6) & 0x3;
 		dst = (a>>3) & 0x7;
 		switch(m){
@@ -247,6 +1193,9 @@ void progress(){
 			reg[dst] = LOAD;
 			break;
 		}
+		if (m != 3){
+			COUNT_EVENT(LDS)
+		}
 #if (DEBUG == 1)
 		printf("LDW %u <- %x\n", dst, reg[dst]);
 #endif
@@ -269,6 +1218,7 @@ void progress(){
 			reg[dst] = ram[LOAD];
 			break;
 		}
+		COUNT_EVENT(LDS)
 #if (DEBUG == 1)
 		printf("LDB %u <- %x\n", dst, reg[dst]);
 #endif
@@ -290,6 +1240,8 @@ void progress(){
 			break;
 		}
 		WRITE(dst_address, preserve)
+		DEVICE_WRITE(dst_address, 4)
+		COUNT_EVENT(STS)
 #if (DEBUG == 1)
 		printf("STR %u (%x) -> %x\n",(a>>3) & 0x7, preserve, dst_address);
 #endif
@@ -311,6 +1263,8 @@ void progress(){
 			break;
 		}
 		ram[dst_address] = preserve & 0xFF;
+		DEVICE_WRITE(dst_address, 1)
+		COUNT_EVENT(STS)
 #if (DEBUG == 1)
 		printf("STB %u (%x) -> %x\n",(a>>3) & 0x7, preserve & 0xFF, dst_address);
 #endif
@@ -320,6 +1274,9 @@ void progress(){
 		src = NEXT;
 		NEXT;
 		reg[dst] = reg[src];
+		if (dst == PC){
+			COUNT_EVENT(BRN)
+		}
 #if (DEBUG == 1)
 		printf("LAR %u <- %u(%x)\n", dst, src, reg[src]);
 #endif
@@ -336,8 +1293,10 @@ void progress(){
 			src_val = reg[NEXT];
 			NEXT;
 		}
-		reg[dst] = reg[op1]+src_val;
-		set_status(reg[dst]);
+		preserve = reg[op1];
+		reg[dst] = preserve+src_val;
+		set_arithmetic_status(reg[dst], (uint64_t)preserve+(word)src_val,
+			(preserve ^ reg[dst]) & ((word)src_val ^ reg[dst]));
 #if (DEBUG == 1)
 		printf("ADD %u (%u) <- %u + %u \n", dst, reg[dst], reg[op1], src_val);
 #endif
@@ -354,8 +1313,10 @@ void progress(){
 			src_val = reg[NEXT];
 			NEXT;
 		}
-		reg[dst] = reg[op1]-src_val;
-		set_status(reg[dst]);
+		preserve = reg[op1];
+		reg[dst] = preserve-src_val;
+		set_arithmetic_status(reg[dst], (uint64_t)preserve-(word)src_val,
+			(preserve ^ (word)src_val) & (preserve ^ reg[dst]));
 #if (DEBUG == 1)
 		printf("SUB %u (%u) <- %u - %u \n", dst, reg[dst], reg[op1], src_val);
 #endif
@@ -372,8 +1333,9 @@ void progress(){
 			src_val = reg[NEXT];
 			NEXT;
 		}
-		reg[dst] = reg[op1]*src_val;
-		set_status(reg[dst]);
+		wide = (uint64_t)reg[op1]*(word)src_val;
+		reg[dst] = wide;
+		set_arithmetic_status(reg[dst], wide, (word)((wide >> 32) != 0) << 31);
 #if (DEBUG == 1)
 		printf("MUL %u (%u) <- %u * %u \n", dst, reg[dst], reg[op1], src_val);
 #endif
@@ -495,6 +1457,62 @@ void progress(){
 		reg[dst] = reg[op1] ^ src_val;
 		set_status(reg[dst]);
 		break;
+	case ADC:
+		a = NEXT;
+		m = a >> 6;
+		dst = (a >> 3) & 0x7;
+		op1 = a & 0x7;
+		if (m){
+			src_val = LOAD;
+		}
+		else{
+			src_val = reg[NEXT];
+			NEXT;
+		}
+		preserve = reg[op1];
+		wide = (uint64_t)preserve+(word)src_val+((reg[SR]>>3) & 1);
+		reg[dst] = wide;
+		set_arithmetic_status(reg[dst], wide,
+			(preserve ^ reg[dst]) & ((word)src_val ^ reg[dst]));
+#if (DEBUG == 1)
+		printf("ADC %u (%u) <- %u + %u + c\n", dst, reg[dst], preserve, src_val);
+#endif
+		break;
+	case SBC:
+		a = NEXT;
+		m = a >> 6;
+		dst = (a >> 3) & 0x7;
+		op1 = a & 0x7;
+		if (m){
+			src_val = LOAD;
+		}
+		else{
+			src_val = reg[NEXT];
+			NEXT;
+		}
+		preserve = reg[op1];
+		wide = (uint64_t)preserve-(word)src_val-((reg[SR]>>3) & 1);
+		reg[dst] = wide;
+		set_arithmetic_status(reg[dst], wide,
+			(preserve ^ (word)src_val) & (preserve ^ reg[dst]));
+#if (DEBUG == 1)
+		printf("SBC %u (%u) <- %u - %u - c\n", dst, reg[dst], preserve, src_val);
+#endif
+		break;
+	case MLW:
+		a = NEXT;
+		dst = (a >> 3) & 0x7;
+		op1 = a & 0x7;
+		op2 = NEXT & 0x7;
+		b = NEXT & 0x7;
+		wide = (uint64_t)reg[op1]*reg[op2];
+		reg[dst] = wide;
+		reg[b] = wide >> 32;
+		set_arithmetic_status(reg[dst], wide, (word)((wide >> 32) != 0) << 31);
+#if (DEBUG == 1)
+		printf("MLW %u:%u <- %lx\n", b, dst, wide);
+#endif
+		break;
 	case COM:
 		a = NEXT;
 		m = a >> 3;
@@ -524,11 +1542,13 @@ void progress(){
 		printf("PSH [%x] <- %u\n", reg[ST], src_val);
 #endif
 		stack_push(src_val);
+		COUNT_EVENT(STS)
 		break;
 	case POP:
 		a = NEXT;
 		dst = a & 0x7;
 		reg[dst] = stack_pop();
+		COUNT_EVENT(LDS)
 		NEXT;
 		NEXT;
 #if (DEBUG == 1)
@@ -540,7 +1560,7 @@ void progress(){
 		y = reg[NEXT];
 		reg[SR] = ((x==y) << 2)
 				   | ((x>y) << 1)
-				   | (0);
+				   | (((word)x<(word)y) << 3);
 		NEXT;
 #if (DEBUG == 1)
 		printf("CMP %u =? %u\n", x, y);
@@ -550,8 +1570,10 @@ void progress(){
 #if (DEBUG == 1)
 		printf("JSR\n");
 #endif
-		if (check_metric(NEXT & 0x7)){
-			reg[PC] = LOAD;
+		m = NEXT;
+		if (check_metric(m & 0xF)){
+			reg[PC] = (m & INDIRECT) ? reg[ram[reg[PC]] & 0x7] : (word)LOAD;
+			COUNT_EVENT(BRN)
 			break;
 		}
 		NEXT;
@@ -561,22 +1583,105 @@ void progress(){
 #if (DEBUG == 1)
 		printf("JSR\n");
 #endif
-		if (check_metric(NEXT & 0x7)){
+		m = NEXT;
+		if (check_metric(m & 0xF)){
+			dst_address = (m & INDIRECT) ? reg[ram[reg[PC]] & 0x7] : (word)READ(reg[PC]);
 			stack_push(reg[FP]);
 			stack_push(reg[PC]+2);
 			reg[FP] = reg[ST];
+			reg[PC] = dst_address;
+			COUNT_EVENT(BRN)
+			break;
+		}
+		NEXT;
+		NEXT;
+		break;
+	case CAL:
+		m = NEXT;
+		dst_address = (m & INDIRECT) ? reg[ram[reg[PC]] & 0x7] : (word)READ(reg[PC]);
+		stack_push(reg[PC]+2);
+		reg[PC] = dst_address;
+		COUNT_EVENT(BRN)
+#if (DEBUG == 1)
+		printf("CAL -> %u\n", reg[PC]);
+#endif
+		break;
+	case RTN:
+		reg[PC] = stack_pop();
+		COUNT_EVENT(BRN)
+#if (DEBUG == 1)
+		printf("RTN -> %u\n", reg[PC]);
+#endif
+		break;
+	case LDA:
+		dst = NEXT & 0x7;
+		reg[dst] = LOAD;
+		break;
+	case IRT:
+		reg[SR] = stack_pop();
+		reg[PC] = stack_pop();
+		in_interrupt = 0;
+#if (DEBUG == 1)
+		printf("IRT -> %u\n", reg[PC]);
+#endif
+		break;
+	case HLT:
+		NEXT;
+		NEXT;
+		NEXT;
+		wait_for_event();
+		break;
+	case PMC:
+		a = NEXT;
+		src = NEXT;
+		NEXT;
+		wide = (src < COUNTER_COUNT) ? counters[src] : 0;
+		reg[(a>>3) & 0x7] = wide & 0xFFFFFFFF;
+		reg[a & 0x7] = wide >> 32;
+		break;
+	case JTB:
+		src = NEXT & 0x7;
+		x = LOAD;
+		if (reg[src] < (word)x){
+			reg[PC] = READ(reg[PC]+(reg[src]*4)+2);
+			COUNT_EVENT(BRN)
+#if (DEBUG == 1)
+			printf("JTB %u -> %u\n", reg[src], reg[PC]);
+#endif
+			break;
+		}
+		reg[PC] += x*4;
+		break;
+	case JTE:
+		reg[PC] += 3;
+		break;
+	case DBN:
+		dst = NEXT & 0x7;
+		reg[dst] -= 1;
+#if (DEBUG == 1)
+		printf("DBN %u\n", reg[dst]);
+#endif
+		if (reg[dst] != 0){
 			reg[PC] = LOAD;
+			COUNT_EVENT(BRN)
 			break;
 		}
 		NEXT;
 		NEXT;
 		break;
+	case CSL:
+		x = NEXT;
+		op1 = NEXT & 0x7;
+		op2 = NEXT & 0x7;
+		reg[(x>>4) & 0x7] = check_metric(x & 0xF) ? reg[op1] : reg[op2];
+		break;
 	case RET:
 		x = stack_pop();
 		reg[ST] = reg[FP];
 		reg[PC] = stack_pop();
 		reg[FP] = stack_pop();
 		stack_push(x);
+		COUNT_EVENT(BRN)
 #if (DEBUG == 1)
 		printf("RET -> %u\n", reg[PC]);
 #endif
@@ -585,7 +1690,185 @@ void progress(){
 #if (DEBUG == 1)
 		printf("INT\n");
 #endif
-		handle_interrupt(NEXT);
+		a = NEXT;
+		if (find_host_call(a) != NULL && find_host_call(a)->pure){
+			find_host_call(a)->fn(reg, ram);
+			reg[PC] += 2;
+		}
+		else {
+			handle_interrupt(a);
+		}
+		COUNT_EVENT(IRQ)
+		break;
+	case MCP:
+		dst = NEXT & 0x7;
+		src = NEXT & 0x7;
+		a = NEXT & 0x7;
+		preserve = 0;
+		if (memory_range(reg[dst], reg[a]) && memory_range(reg[src], reg[a])){
+			memmove(ram+reg[dst], ram+reg[src], reg[a]);
+			preserve = reg[a];
+			DEVICE_WRITE(reg[dst], preserve)
+		}
+		set_status(preserve);
+		COUNT_EVENT(LDS)
+		COUNT_EVENT(STS)
+#if (DEBUG == 1)
+		printf("MCP %x <- %x (%u)\n", reg[dst], reg[src], preserve);
+#endif
+		break;
+	case FIL:
+		dst = NEXT & 0x7;
+		src = NEXT & 0x7;
+		a = NEXT & 0x7;
+		preserve = 0;
+		if (memory_range(reg[dst], reg[a])){
+			memset(ram+reg[dst], reg[src] & 0xFF, reg[a]);
+			preserve = reg[a];
+			DEVICE_WRITE(reg[dst], preserve)
+		}
+		set_status(preserve);
+		COUNT_EVENT(STS)
+#if (DEBUG == 1)
+		printf("FIL %x <- %x (%u)\n", reg[dst], reg[src] & 0xFF, preserve);
+#endif
+		break;
+	case SCN:
+		dst = NEXT & 0x7;
+		src = NEXT & 0x7;
+		a = NEXT & 0x7;
+		reg[SR] = 0;
+		if (memory_range(reg[dst], reg[a])){
+			offset = scan_byte(ram+reg[dst], reg[a], reg[src] & 0xFF);
+			reg[SR] = (offset != reg[a]) << 2;
+			reg[dst] += offset;
+		}
+		COUNT_EVENT(LDS)
+#if (DEBUG == 1)
+		printf("SCN %x (%x)\n", reg[dst], reg[SR]);
+#endif
+		break;
+	case CPB:
+		op1 = NEXT & 0x7;
+		op2 = NEXT & 0x7;
+		a = NEXT & 0x7;
+		reg[SR] = 0;
+		if (memory_range(reg[op1], reg[a]) && memory_range(reg[op2], reg[a])){
+			offset = compare_bytes(ram+reg[op1], ram+reg[op2], reg[a]);
+			x = (offset == reg[a]) ? 0 : ram[reg[op1]+offset];
+			y = (offset == reg[a]) ? 0 : ram[reg[op2]+offset];
+			reg[SR] = ((x==y) << 2)
+					| ((x>y) << 1);
+		}
+		COUNT_EVENT(LDS)
+#if (DEBUG == 1)
+		printf("CPB %x =? %x (%x)\n", reg[op1], reg[op2], reg[SR]);
+#endif
+		break;
+	case SLN:
+		dst = NEXT & 0x7;
+		src = NEXT & 0x7;
+		NEXT;
+		src_address = reg[src];
+		preserve = region_end(src_address);
+		reg[dst] = (preserve == 0) ? 0 : scan_byte(ram+src_address, preserve-src_address, 0);
+		set_status(reg[dst]);
+		COUNT_EVENT(LDS)
+#if (DEBUG == 1)
+		printf("SLN %u <- %u\n", dst, reg[dst]);
+#endif
+		break;
+	case VLD:
+		a = NEXT;
+		src_address = reg[NEXT & 0x7];
+		NEXT;
+		if (memory_range(src_address, sizeof(vector))){
+			memcpy(&vreg[(a>>3) & 0x7], ram+src_address, sizeof(vector));
+			vreg[(a>>3) & 0x7] = swap_lanes(vreg[(a>>3) & 0x7], a>>6);
+		}
+		COUNT_EVENT(LDS)
+		break;
+	case VST:
+		a = NEXT;
+		dst_address = reg[NEXT & 0x7];
+		NEXT;
+		if (memory_range(dst_address, sizeof(vector))){
+			vector v = swap_lanes(vreg[(a>>3) & 0x7], a>>6);
+			memcpy(ram+dst_address, &v, sizeof(vector));
+			DEVICE_WRITE(dst_address, sizeof(vector))
+		}
+		COUNT_EVENT(STS)
+		break;
+	case VSP:
+		a = NEXT;
+		src_val = reg[NEXT & 0x7];
+		NEXT;
+		dst = (a>>3) & 0x7;
+		switch (a>>6){
+		case B: vreg[dst].b = (vec8){0} + (uint8_t)src_val; break;
+		case H: vreg[dst].h = (vec16){0} + (uint16_t)src_val; break;
+		case W: vreg[dst].w = (vec32){0} + (uint32_t)src_val; break;
+		}
+		break;
+	case VEX:
+		a = NEXT;
+		b = NEXT;
+		NEXT;
+		dst = (a>>3) & 0x7;
+		switch (a>>6){
+		case B: reg[dst] = vreg[a & 0x7].b[b & 0xF]; break;
+		case H: reg[dst] = vreg[a & 0x7].h[b & 0x7]; break;
+		case W: reg[dst] = vreg[a & 0x7].w[b & 0x3]; break;
+		}
+#if (DEBUG == 1)
+		printf("VEX %u <- %x\n", dst, reg[dst]);
+#endif
+		break;
+	case VAD: VECTOR_OP(+) break;
+	case VSB: VECTOR_OP(-) break;
+	case VML: VECTOR_OP(*) break;
+	case VAN: VECTOR_OP(&) break;
+	case VOR: VECTOR_OP(|) break;
+	case VXR: VECTOR_OP(^) break;
+	case VEQ: VECTOR_OP(==) break;
+	case VGT: VECTOR_OP(>) break;
+	case FAD: FLOAT_OP(+) break;
+	case FSB: FLOAT_OP(-) break;
+	case FML: FLOAT_OP(*) break;
+	case FDV: FLOAT_OP(/) break;
+	case FCM:
+		op1 = NEXT & 0x7;
+		op2 = NEXT & 0x7;
+		NEXT;
+		reg[SR] = ((as_float(reg[op1]) == as_float(reg[op2])) << 2)
+				| ((as_float(reg[op1]) > as_float(reg[op2])) << 1)
+				| ((as_float(reg[op1]) < as_float(reg[op2])) << 3)
+				| ((isnan(as_float(reg[op1])) || isnan(as_float(reg[op2]))) << 4);
+#if (DEBUG == 1)
+		printf("FCM %f =? %f\n", as_float(reg[op1]), as_float(reg[op2]));
+#endif
+		break;
+	case ITF:
+		dst = NEXT & 0x7;
+		src = NEXT & 0x7;
+		NEXT;
+		reg[dst] = from_float((int32_t)reg[src]);
+		break;
+	case FTI:
+		dst = NEXT & 0x7;
+		src = NEXT & 0x7;
+		NEXT;
+		reg[dst] = float_to_int(as_float(reg[src]));
+		break;
+	case LDC:
+		dst = NEXT & 0x7;
+		src_address = reg[PC]-2;
+		src_address += (LOAD)*4;
+		LOAD_WORD(dst, src_address)
+		COUNT_EVENT(LDS)
+#if (DEBUG == 1)
+		printf("LDC %u <- [%x] %x\n", dst, src_address, reg[dst]);
+#endif
 		break;
 	case NOP:
 #if (DEBUG == 1)
@@ -659,7 +1942,40 @@ void display_machine(){
 	DISPLAY_REG(SR);
 }
 
-void run_rom(uint8_t debug){
+static uint32_t pc_hits[PROG_SIZE/4];
+
+void write_profile(FILE* fd){
+	for (word i = 0;i<PROG_SIZE/4;++i){
+		if (pc_hits[i]){
+			fprintf(fd, "x%x %u\n", i*4, pc_hits[i]);
+		}
+	}
+	fclose(fd);
+}
+
+void deliver_interrupt(){
+	word pending = atomic_load(&pending_interrupts);
+	byte vector = __builtin_ctz(pending);
+	atomic_fetch_and(&pending_interrupts, ~(1u << vector));
+	word entry = vector_base+(vector*4);
+	if (!memory_range(entry, 4)){
+		return;
+	}
+	word handler = (ram[entry]<<24) | (ram[entry+1]<<16) | (ram[entry+2]<<8) | ram[entry+3];
+	if (handler == 0){
+		return;
+	}
+	stack_push(reg[PC]);
+	stack_push(reg[SR]);
+	in_interrupt = 1;
+	reg[PC] = handler;
+	COUNT_EVENT(IRQ)
+#if (DEBUG == 1)
+	printf("interrupt %u -> %u\n", vector, handler);
+#endif
+}
+
+void run_rom(uint8_t debug, uint8_t profile){
 	reg[PC] = PROG_ADDRESS;
 	reg[ST] = RAM_SIZE-1;
 	reg[FP] = reg[ST];
@@ -668,6 +1984,13 @@ void run_rom(uint8_t debug){
 			getc(stdin);
 			display_machine();
 		}
+		if (profile && reg[PC] < PROG_SIZE){
+			pc_hits[reg[PC]/4] += 1;
+		}
+		if (atomic_load_explicit(&pending_interrupts, memory_order_relaxed) && vector_base != 0 && !in_interrupt){
+			deliver_interrupt();
+		}
+		counters[INS] += 1;
 		progress();
 	}
 	printf("INFO rom exited with code %x\n", stack_pop());
@@ -743,11 +2066,21 @@ int32_t parse_numeric(FILE* fd, uint8_t* err){
 	char num[] = "................................";
 	uint8_t i = 0;
 	char c = fgetc(fd);
-	while(c != EOF && i < 10 && (!whitespace(c))){
+	while(c != EOF && i < sizeof(num)-1 && (!whitespace(c))){
 		num[i++] = c;
 		c = fgetc(fd);
 	}
-	assert_error(c!=EOF)
+	assert_error(c!=EOF && whitespace(c))
+	num[i] = '\0';
+	if (strchr(num, '.') != NULL){
+		char* end;
+		float f = strtof(num, &end);
+		assert_error(*end == '\0')
+#if (DEBUG==1)
+		printf("(%s = %f) ", num, f);
+#endif
+		return from_float(f);
+	}
 	char pivot = num[0];
 	if (pivot=='x'){
 		base = 16;
@@ -783,6 +2116,24 @@ void push_2bytes(byte* encoded, size_t* const size, word address){
 		}
 }
 
+static word constant_pool[POOL_SIZE];
+static size_t pool_size = 0;
+
+uint8_t push_constant(byte* encoded, size_t* const size, byte r, word value){
+	size_t slot = 0;
+	while (slot < pool_size && constant_pool[slot] != value){
+		slot += 1;
+	}
+	assert_return(slot < POOL_SIZE)
+	if (slot == pool_size){
+		constant_pool[pool_size++] = value;
+	}
+	encoded[(*size)-1] = LDC;
+	encoded[(*size)++] = r;
+	push_2bytes(encoded, size, slot);
+	return 1;
+}
+
 uint8_t parse_LAR(FILE* const fd, byte* encoded, size_t* const size){
 	encoded[(*size)++] = LAR;
 #if (DEBUG==1)
@@ -791,11 +2142,17 @@ uint8_t parse_LAR(FILE* const fd, byte* encoded, size_t* const size){
 	char c = parse_spaces(fd);
 	assert_return(c!=EOF)
 	uint8_t err = 0;
-	byte r = parse_register(fd, c, &err);
-	assert_return(!err)
+	byte r = PC;
+	if (c == 'P'){
+		assert_return(fgetc(fd) == 'C' && whitespace(fgetc(fd)))
+	}
+	else {
+		r = parse_register(fd, c, &err);
+		assert_return(!err)
+	}
 	c = parse_spaces(fd);
 	assert_return(c!=EOF)
-	byte s = parse_aux_register(fd, c, &err);
+	byte s = (c == 'R') ? parse_register(fd, c, &err) : parse_aux_register(fd, c, &err);
 	assert_return(!err)
 	encoded[(*size)++] = r;
 	encoded[(*size)++] = s;
@@ -817,7 +2174,7 @@ uint8_t parse_LDW(FILE* const fd, byte* encoded, size_t* const size){
 	assert_return(c!=EOF)
 	if (c=='&'){
 		word address = parse_numeric(fd, &err);
-		assert_return(!err)
+		assert_return(!err && address <= 0xFFFF)
 		encoded[(*size)++] = (0x2 << 6) | (r << 3);
 		push_2bytes(encoded, size, address);
 		return 1;
@@ -825,6 +2182,9 @@ uint8_t parse_LDW(FILE* const fd, byte* encoded, size_t* const size){
 	else if (c=='#'){
 		int32_t value = parse_numeric(fd, &err);
 		assert_return(!err)
+		if (value < 0 || value > 0xFFFF){
+			return push_constant(encoded, size, r, value);
+		}
 		encoded[(*size)++] = (0x3 << 6) | (r << 3);
 		push_2bytes(encoded, size, value);
 		return 1;
@@ -835,7 +2195,7 @@ uint8_t parse_LDW(FILE* const fd, byte* encoded, size_t* const size){
 	assert_return(c!=EOF && c!= '&')
 	if (c == '#'){
 		int32_t value = parse_numeric(fd, &err);
-		assert_return(!err)
+		assert_return(!err && value >= 0 && value <= 0xFFFF)
 		encoded[(*size)++] = (0x1 << 6) | (r << 3) | s;
 		push_2bytes(encoded, size, value);
 		return 1;
@@ -862,7 +2222,7 @@ uint8_t parse_LDB(FILE* const fd, byte* encoded, size_t* const size){
 	assert_return(c!=EOF && c!='#')
 	if (c=='&'){
 		word address = parse_numeric(fd, &err);
-		assert_return(!err)
+		assert_return(!err && address <= 0xFFFF)
 		encoded[(*size)++] = (0x2 << 6) | (r << 3);
 		push_2bytes(encoded, size, address);
 		return 1;
@@ -873,7 +2233,7 @@ uint8_t parse_LDB(FILE* const fd, byte* encoded, size_t* const size){
 	assert_return(c!=EOF && c!= '&')
 	if (c == '#'){
 		int32_t value = parse_numeric(fd, &err);
-		assert_return(!err)
+		assert_return(!err && value >= 0 && value <= 0xFFFF)
 		encoded[(*size)++] = (0x1 << 6) | (r << 3) | s;
 		push_2bytes(encoded, size, value);
 		return 1;
@@ -900,7 +2260,7 @@ uint8_t parse_STR(FILE* fd, byte* encoded, size_t* const size){
 	assert_return(c!=EOF && c!='#')
 	if (c=='&'){
 		word address = parse_numeric(fd, &err);
-		assert_return(!err)
+		assert_return(!err && address <= 0xFFFF)
 		encoded[(*size)++] = (0x2 << 6) | (r << 3);
 		push_2bytes(encoded, size, address);
 		return 1;
@@ -911,7 +2271,7 @@ uint8_t parse_STR(FILE* fd, byte* encoded, size_t* const size){
 	assert_return(c!=EOF && c!= '&')
 	if (c == '#'){
 		int32_t value = parse_numeric(fd, &err);
-		assert_return(!err)
+		assert_return(!err && value >= 0 && value <= 0xFFFF)
 		encoded[(*size)++] = (0x1 << 6) | (r << 3) | s;
 		push_2bytes(encoded, size, value);
 		return 1;
@@ -938,7 +2298,7 @@ uint8_t parse_STB(FILE* fd, byte* encoded, size_t* const size){
 	assert_return(c!=EOF && c!='#')
 	if (c=='&'){
 		word address = parse_numeric(fd, &err);
-		assert_return(!err)
+		assert_return(!err && address <= 0xFFFF)
 		encoded[(*size)++] = (0x2 << 6) | (r << 3);
 		push_2bytes(encoded, size, address);
 		return 1;
@@ -949,7 +2309,7 @@ uint8_t parse_STB(FILE* fd, byte* encoded, size_t* const size){
 	assert_return(c!=EOF && c!= '&')
 	if (c == '#'){
 		int32_t value = parse_numeric(fd, &err);
-		assert_return(!err)
+		assert_return(!err && value >= 0 && value <= 0xFFFF)
 		encoded[(*size)++] = (0x1 << 6) | (r << 3) | s;
 		push_2bytes(encoded, size, value);
 		return 1;
@@ -976,7 +2336,7 @@ uint8_t parse_alu_op(FILE* fd, byte* encoded, size_t* const size){
 	assert_return(c!=EOF)
 	if (c=='#'){
 		int32_t val = parse_numeric(fd, &err);
-		assert_return(!err);
+		assert_return(!err && val >= 0 && val <= 0xFFFF)
 		encoded[(*size)++] = (1<<6) | (dst<<3) | op1;
 		push_2bytes(encoded, size, val);
 		return 1;
@@ -1029,6 +2389,41 @@ uint8_t parse_MOD(FILE* fd, byte* encoded, size_t* const size){
 	return parse_alu_op(fd, encoded, size);
 }
 
+uint8_t parse_ADC(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("ADC ");
+#endif
+	encoded[(*size)++] = ADC;
+	return parse_alu_op(fd, encoded, size);
+}
+
+uint8_t parse_SBC(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("SBC ");
+#endif
+	encoded[(*size)++] = SBC;
+	return parse_alu_op(fd, encoded, size);
+}
+
+uint8_t parse_MLW(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("MLW ");
+#endif
+	encoded[(*size)++] = MLW;
+	byte r[4];
+	uint8_t err = 0;
+	for (uint8_t i = 0;i<4;++i){
+		char c = parse_spaces(fd);
+		assert_return(c!=EOF)
+		r[i] = parse_register(fd, c, &err);
+		assert_return(!err)
+	}
+	encoded[(*size)++] = (r[0]<<3) | r[2];
+	encoded[(*size)++] = r[3];
+	encoded[(*size)++] = r[1];
+	return 1;
+}
+
 uint8_t parse_2_register_byte(FILE* fd, byte* encoded, size_t* const size){
 	char c = parse_spaces(fd);
 	assert_return(c!=EOF)
@@ -1043,43 +2438,271 @@ uint8_t parse_2_register_byte(FILE* fd, byte* encoded, size_t* const size){
 	return 1;
 }
 
-uint8_t parse_LSL(FILE* fd, byte* encoded, size_t* const size){
-#if (DEBUG==1)
-	printf("LSL ");
-#endif
-	encoded[(*size)++] = LSL;
-	return parse_alu_op(fd, encoded, size);
+uint8_t parse_3_register(FILE* fd, byte* encoded, size_t* const size){
+	uint8_t err = 0;
+	for (uint8_t i = 0;i<3;++i){
+		char c = parse_spaces(fd);
+		assert_return(c!=EOF)
+		encoded[(*size)++] = parse_register(fd, c, &err);
+		assert_return(!err)
+	}
+	return 1;
 }
 
-uint8_t parse_LSR(FILE* fd, byte* encoded, size_t* const size){
+uint8_t parse_MCP(FILE* fd, byte* encoded, size_t* const size){
 #if (DEBUG==1)
-	printf("LSR ");
+	printf("MCP ");
 #endif
-	encoded[(*size)++] = LSR;
-	return parse_alu_op(fd, encoded, size);
+	encoded[(*size)++] = MCP;
+	return parse_3_register(fd, encoded, size);
 }
 
-uint8_t parse_AND(FILE* fd, byte* encoded, size_t* const size){
+uint8_t parse_FIL(FILE* fd, byte* encoded, size_t* const size){
 #if (DEBUG==1)
-	printf("AND ");
+	printf("FIL ");
 #endif
-	encoded[(*size)++] = AND;
-	return parse_alu_op(fd, encoded, size);
+	encoded[(*size)++] = FIL;
+	return parse_3_register(fd, encoded, size);
 }
 
-uint8_t parse_ORR(FILE* fd, byte* encoded, size_t* const size){
+uint8_t parse_SCN(FILE* fd, byte* encoded, size_t* const size){
 #if (DEBUG==1)
-	printf("ORR ");
+	printf("SCN ");
 #endif
-	encoded[(*size)++] = ORR;
-	return parse_alu_op(fd, encoded, size);
+	encoded[(*size)++] = SCN;
+	return parse_3_register(fd, encoded, size);
 }
 
-uint8_t parse_XOR(FILE* fd, byte* encoded, size_t* const size){
+uint8_t parse_CPB(FILE* fd, byte* encoded, size_t* const size){
 #if (DEBUG==1)
-	printf("XOR ");
+	printf("CPB ");
 #endif
-	encoded[(*size)++] = XOR;
+	encoded[(*size)++] = CPB;
+	return parse_3_register(fd, encoded, size);
+}
+
+uint8_t parse_2_register(FILE* fd, byte* encoded, size_t* const size){
+	char c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	uint8_t err = 0;
+	byte dst = parse_register(fd, c, &err);
+	assert_return(!err)
+	c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	byte src = parse_register(fd, c, &err);
+	assert_return(!err)
+	encoded[(*size)++] = dst;
+	encoded[(*size)++] = src;
+	*size += 1;
+	return 1;
+}
+
+uint8_t parse_SLN(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("SLN ");
+#endif
+	encoded[(*size)++] = SLN;
+	return parse_2_register(fd, encoded, size);
+}
+
+#define PARSE_FLOAT_OP(tok, parse)\
+uint8_t parse_##tok(FILE* fd, byte* encoded, size_t* const size){\
+	encoded[(*size)++] = tok;\
+	return parse(fd, encoded, size);\
+}
+
+PARSE_FLOAT_OP(FAD, parse_3_register)
+PARSE_FLOAT_OP(FSB, parse_3_register)
+PARSE_FLOAT_OP(FML, parse_3_register)
+PARSE_FLOAT_OP(FDV, parse_3_register)
+PARSE_FLOAT_OP(FCM, parse_2_register)
+PARSE_FLOAT_OP(ITF, parse_2_register)
+PARSE_FLOAT_OP(FTI, parse_2_register)
+
+byte parse_vector_register(FILE* fd, char c, uint8_t* err){
+	char r[] = "..";
+	uint8_t i = 0;
+	while (c != EOF && i < 2){
+		r[i++] = c;
+		c = fgetc(fd);
+	}
+	assert_error(c!=EOF)
+#if (DEBUG==1)
+	printf("%s ", r);
+#endif
+	MATCH_REGISTER(V0)
+	MATCH_REGISTER(V1)
+	MATCH_REGISTER(V2)
+	MATCH_REGISTER(V3)
+	MATCH_REGISTER(V4)
+	MATCH_REGISTER(V5)
+	MATCH_REGISTER(V6)
+	MATCH_REGISTER(V7)
+	{
+		*err = 1;
+		return 0;
+	}
+}
+
+byte parse_width(FILE* fd, char c, uint8_t* err){
+	char w = c;
+	c = fgetc(fd);
+	assert_error(whitespace(c))
+#if (DEBUG==1)
+	printf("%c ", w);
+#endif
+	switch (w){
+	case 'B': return B;
+	case 'H': return H;
+	case 'W': return W;
+	}
+	*err = 1;
+	return 0;
+}
+
+uint8_t parse_vector_memory(FILE* fd, byte* encoded, size_t* const size){
+	char c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	uint8_t err = 0;
+	byte width = parse_width(fd, c, &err);
+	assert_return(!err)
+	c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	byte v = parse_vector_register(fd, c, &err);
+	assert_return(!err)
+	c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	byte r = parse_register(fd, c, &err);
+	assert_return(!err)
+	encoded[(*size)++] = (width<<6) | (v<<3);
+	encoded[(*size)++] = r;
+	*size += 1;
+	return 1;
+}
+
+uint8_t parse_VLD(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("VLD ");
+#endif
+	encoded[(*size)++] = VLD;
+	return parse_vector_memory(fd, encoded, size);
+}
+
+uint8_t parse_VST(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("VST ");
+#endif
+	encoded[(*size)++] = VST;
+	return parse_vector_memory(fd, encoded, size);
+}
+
+uint8_t parse_VSP(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("VSP ");
+#endif
+	encoded[(*size)++] = VSP;
+	return parse_vector_memory(fd, encoded, size);
+}
+
+uint8_t parse_VEX(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("VEX ");
+#endif
+	encoded[(*size)++] = VEX;
+	char c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	uint8_t err = 0;
+	byte width = parse_width(fd, c, &err);
+	assert_return(!err)
+	c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	byte r = parse_register(fd, c, &err);
+	assert_return(!err)
+	c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	byte v = parse_vector_register(fd, c, &err);
+	assert_return(!err)
+	c = parse_spaces(fd);
+	assert_return(c=='#')
+	int32_t lane = parse_numeric(fd, &err);
+	assert_return(!err && lane >= 0 && lane < (16 >> width))
+	encoded[(*size)++] = (width<<6) | (r<<3) | v;
+	encoded[(*size)++] = lane;
+	*size += 1;
+	return 1;
+}
+
+uint8_t parse_vector_op(FILE* fd, byte* encoded, size_t* const size){
+	char c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	uint8_t err = 0;
+	byte width = parse_width(fd, c, &err);
+	assert_return(!err)
+	byte v[3];
+	for (uint8_t i = 0;i<3;++i){
+		c = parse_spaces(fd);
+		assert_return(c!=EOF)
+		v[i] = parse_vector_register(fd, c, &err);
+		assert_return(!err)
+	}
+	encoded[(*size)++] = (width<<6) | (v[0]<<3) | v[1];
+	encoded[(*size)++] = v[2];
+	*size += 1;
+	return 1;
+}
+
+#define PARSE_VECTOR_OP(tok)\
+uint8_t parse_##tok(FILE* fd, byte* encoded, size_t* const size){\
+	encoded[(*size)++] = tok;\
+	return parse_vector_op(fd, encoded, size);\
+}
+
+PARSE_VECTOR_OP(VAD)
+PARSE_VECTOR_OP(VSB)
+PARSE_VECTOR_OP(VML)
+PARSE_VECTOR_OP(VAN)
+PARSE_VECTOR_OP(VOR)
+PARSE_VECTOR_OP(VXR)
+PARSE_VECTOR_OP(VEQ)
+PARSE_VECTOR_OP(VGT)
+
+uint8_t parse_LSL(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("LSL ");
+#endif
+	encoded[(*size)++] = LSL;
+	return parse_alu_op(fd, encoded, size);
+}
+
+uint8_t parse_LSR(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("LSR ");
+#endif
+	encoded[(*size)++] = LSR;
+	return parse_alu_op(fd, encoded, size);
+}
+
+uint8_t parse_AND(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("AND ");
+#endif
+	encoded[(*size)++] = AND;
+	return parse_alu_op(fd, encoded, size);
+}
+
+uint8_t parse_ORR(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("ORR ");
+#endif
+	encoded[(*size)++] = ORR;
+	return parse_alu_op(fd, encoded, size);
+}
+
+uint8_t parse_XOR(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("XOR ");
+#endif
+	encoded[(*size)++] = XOR;
 	return parse_alu_op(fd, encoded, size);
 }
 
@@ -1098,7 +2721,7 @@ uint8_t parse_COM(FILE* fd, byte* encoded, size_t* const size){
 	if (c=='#'){
 		encoded[(*size)++] = (1<<3) | dst;
 		int32_t val = parse_numeric(fd, &err);
-		assert_return(!err)
+		assert_return(!err && val >= 0 && val <= 0xFFFF)
 		push_2bytes(encoded, size, val);
 		return 1;
 	}
@@ -1121,7 +2744,7 @@ uint8_t parse_PSH(FILE* fd, byte* encoded, size_t* const size){
 	if (c=='#'){
 		encoded[(*size)++] = 0;
 		int32_t val = parse_numeric(fd, &err);
-		assert_return(!err);
+		assert_return(!err && val >= 0 && val <= 0xFFFF)
 		push_2bytes(encoded, size, val);
 		return 1;
 	}
@@ -1186,6 +2809,10 @@ uint8_t parse_metric(FILE* fd, char c, byte* encoded, size_t* const size){
 	MATCH_METRIC(GT)
 	MATCH_METRIC(LE)
 	MATCH_METRIC(GE)
+	MATCH_METRIC(CS)
+	MATCH_METRIC(CC)
+	MATCH_METRIC(VS)
+	MATCH_METRIC(VC)
 	{
 		encoded[(*size)++]=NC;
 	}
@@ -1222,16 +2849,9 @@ uint32_t seek_jump_label(label_assoc** labels, char* lab, size_t ip){
 	return 0;
 }
 
-uint8_t parse_JSR(FILE* fd, byte* encoded, size_t* const size, label_assoc** labels){
-#if (DEBUG==1)
-	printf("JSR ");
-#endif
-	encoded[(*size)++] = JSR;
+uint8_t parse_jump_label(FILE* fd, byte* encoded, size_t* const size, label_assoc** labels, uint8_t indirect){
 	char c = parse_spaces(fd);
 	assert_return(c!=EOF)
-	assert_return(parse_metric(fd, c, encoded, size))
-	c = parse_spaces(fd);
-	assert_return(c!=EOF)
 	char lab[8] = "labelMax";
 	size_t i = 0;
 	while (c!=EOF && i<8 && !whitespace(c)){
@@ -1240,11 +2860,28 @@ uint8_t parse_JSR(FILE* fd, byte* encoded, size_t* const size, label_assoc** lab
 	}
 	assert_return(whitespace(c));
 	lab[i] = '\0';
+	if (indirect && i == 2 && lab[0] == 'R' && lab[1] >= '0' && lab[1] <= '7'){
+		encoded[(*size)-1] |= INDIRECT;
+		encoded[(*size)++] = lab[1]-'0';
+		*size += 1;
+		return 1;
+	}
 	word label = seek_jump_label(labels, lab, *size);
 	push_2bytes(encoded, size, label);
 	return 1;
 }
 
+uint8_t parse_JSR(FILE* fd, byte* encoded, size_t* const size, label_assoc** labels){
+#if (DEBUG==1)
+	printf("JSR ");
+#endif
+	encoded[(*size)++] = JSR;
+	char c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	assert_return(parse_metric(fd, c, encoded, size))
+	return parse_jump_label(fd, encoded, size, labels, 1);
+}
+
 uint8_t parse_JMP(FILE* fd, byte* encoded, size_t* const size, label_assoc** labels){
 #if (DEBUG==1)
 	printf("JMP ");
@@ -1253,33 +2890,128 @@ uint8_t parse_JMP(FILE* fd, byte* encoded, size_t* const size, label_assoc** lab
 	char c = parse_spaces(fd);
 	assert_return(c!=EOF)
 	assert_return(parse_metric(fd, c, encoded, size))
-	c = parse_spaces(fd);
+	return parse_jump_label(fd, encoded, size, labels, 1);
+}
+
+uint8_t parse_DBN(FILE* fd, byte* encoded, size_t* const size, label_assoc** labels){
+#if (DEBUG==1)
+	printf("DBN ");
+#endif
+	encoded[(*size)++] = DBN;
+	char c = parse_spaces(fd);
 	assert_return(c!=EOF)
-	char lab[8] = "labelMax";
-	size_t i = 0;
-	while (c!=EOF && i<8 && !whitespace(c)){
-		lab[i++] = c;
-		c = fgetc(fd);
-	}
-	assert_return(whitespace(c));
-	lab[i] = '\0';
-	word label = seek_jump_label(labels, lab, *size);
-	push_2bytes(encoded, size, label);
+	uint8_t err = 0;
+	byte r = parse_register(fd, c, &err);
+	assert_return((!err) && (r < 8))
+	encoded[(*size)++] = r;
+	return parse_jump_label(fd, encoded, size, labels, 0);
+}
+
+uint8_t parse_CAL(FILE* fd, byte* encoded, size_t* const size, label_assoc** labels){
+#if (DEBUG==1)
+	printf("CAL ");
+#endif
+	encoded[(*size)++] = CAL;
+	encoded[(*size)++] = 0;
+	return parse_jump_label(fd, encoded, size, labels, 1);
+}
+
+uint8_t parse_TCL(FILE* fd, byte* encoded, size_t* const size, label_assoc** labels){
+#if (DEBUG==1)
+	printf("TCL ");
+#endif
+	encoded[(*size)++] = JMP;
+	encoded[(*size)++] = NC;
+	return parse_jump_label(fd, encoded, size, labels, 1);
+}
+
+uint8_t parse_IRT(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("IRT ");
+#endif
+	encoded[(*size)++] = IRT;
+	*size += 3;
 	return 1;
 }
 
-uint8_t parse_RET(FILE* fd, byte* encoded, size_t* const size){
+uint8_t parse_HLT(FILE* fd, byte* encoded, size_t* const size){
 #if (DEBUG==1)
-	printf("RET ");
+	printf("HLT ");
 #endif
-	encoded[(*size)++] = RET;
+	encoded[(*size)++] = HLT;
 	*size += 3;
 	return 1;
 }
 
-#define MATCH_INTERRUPT(tok) if (strcmp(#tok, op) == 0) { encoded[(*size)++] = tok; } else
+uint8_t parse_RTN(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("RTN ");
+#endif
+	encoded[(*size)++] = RTN;
+	*size += 3;
+	return 1;
+}
 
-uint8_t parse_interrupt(FILE* fd, char c, byte* encoded, size_t* const size){
+uint8_t parse_LDA(FILE* fd, byte* encoded, size_t* const size, label_assoc** labels){
+#if (DEBUG==1)
+	printf("LDA ");
+#endif
+	encoded[(*size)++] = LDA;
+	char c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	uint8_t err = 0;
+	byte r = parse_register(fd, c, &err);
+	assert_return((!err) && (r < 8))
+	encoded[(*size)++] = r;
+	return parse_jump_label(fd, encoded, size, labels, 0);
+}
+
+uint8_t parse_JTB(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("JTB ");
+#endif
+	encoded[(*size)++] = JTB;
+	char c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	uint8_t err = 0;
+	byte r = parse_register(fd, c, &err);
+	assert_return((!err) && (r < 8))
+	encoded[(*size)++] = r;
+	c = parse_spaces(fd);
+	assert_return(c=='#')
+	int32_t entries = parse_numeric(fd, &err);
+	assert_return((!err) && (entries >= 0) && (entries <= 0xFFFF))
+	push_2bytes(encoded, size, entries);
+	return 1;
+}
+
+uint8_t parse_JTE(FILE* fd, byte* encoded, size_t* const size, label_assoc** labels){
+#if (DEBUG==1)
+	printf("JTE ");
+#endif
+	encoded[(*size)++] = JTE;
+	encoded[(*size)++] = 0;
+	return parse_jump_label(fd, encoded, size, labels, 0);
+}
+
+#define MATCH_COUNTER(tok) if (strcmp(#tok, op) == 0) { encoded[(*size)++] = tok; } else
+
+uint8_t parse_PMC(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("PMC ");
+#endif
+	encoded[(*size)++] = PMC;
+	char c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	uint8_t err = 0;
+	byte lo = parse_register(fd, c, &err);
+	assert_return((!err) && (lo < 8))
+	c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	byte hi = parse_register(fd, c, &err);
+	assert_return((!err) && (hi < 8))
+	encoded[(*size)++] = (lo<<3) | hi;
+	c = parse_spaces(fd);
 	char op[] = "...";
 	uint8_t i = 0;
 	while (c != EOF && i < 3){
@@ -1287,25 +3019,100 @@ uint8_t parse_interrupt(FILE* fd, char c, byte* encoded, size_t* const size){
 		c = fgetc(fd);
 	}
 	assert_return(c!=EOF)
-#if (DEBUG==1)
-	printf("%s ", op);
-#endif
-	MATCH_INTERRUPT(KBD)
-	MATCH_INTERRUPT(OUT)
+	MATCH_COUNTER(INS)
+	MATCH_COUNTER(LDS)
+	MATCH_COUNTER(STS)
+	MATCH_COUNTER(BRN)
+	MATCH_COUNTER(IRQ)
 	{
-#if (DEBUG==1)
-		printf("(END)\n");
-#endif
-		encoded[(*size)++]=END;
+		printf("unknown counter %s\n", op);
+		return 0;
 	}
-	*size += 2;
+	*size += 1;
 	return 1;
-
 }
 
-uint8_t parse_INT(FILE* fd, byte* encoded, size_t* const size){
+uint8_t parse_CSL(FILE* fd, byte* encoded, size_t* const size){
 #if (DEBUG==1)
-	printf("INT ");
+	printf("CSL ");
+#endif
+	encoded[(*size)++] = CSL;
+	char c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	assert_return(parse_metric(fd, c, encoded, size))
+	c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	uint8_t err = 0;
+	byte dst = parse_register(fd, c, &err);
+	assert_return((!err) && (dst < 8))
+	encoded[(*size)-1] |= dst << 4;
+	c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	byte op1 = parse_register(fd, c, &err);
+	assert_return(!err)
+	c = parse_spaces(fd);
+	assert_return(c!=EOF)
+	byte op2 = parse_register(fd, c, &err);
+	assert_return(!err)
+	encoded[(*size)++] = op1;
+	encoded[(*size)++] = op2;
+	return 1;
+}
+
+uint8_t parse_RET(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("RET ");
+#endif
+	encoded[(*size)++] = RET;
+	*size += 3;
+	return 1;
+}
+
+#define MATCH_INTERRUPT(tok) if (strcmp(#tok, op) == 0) { encoded[(*size)++] = tok; } else
+
+uint8_t parse_interrupt(FILE* fd, char c, byte* encoded, size_t* const size){
+	if (c == '#'){
+		uint8_t err = 0;
+		int32_t number = parse_numeric(fd, &err);
+		assert_return(!err && number >= 0 && number <= 0xFF)
+		encoded[(*size)++] = number;
+		*size += 2;
+		return 1;
+	}
+	char op[] = "...";
+	uint8_t i = 0;
+	while (c != EOF && i < 3){
+		op[i++] = c;
+		c = fgetc(fd);
+	}
+	assert_return(c!=EOF)
+#if (DEBUG==1)
+	printf("%s ", op);
+#endif
+	MATCH_INTERRUPT(KBD)
+	MATCH_INTERRUPT(OUT)
+	MATCH_INTERRUPT(VEC)
+	MATCH_INTERRUPT(MAP)
+	MATCH_INTERRUPT(SYN)
+	MATCH_INTERRUPT(IOS)
+	MATCH_INTERRUPT(IOQ)
+	MATCH_INTERRUPT(ALC)
+	MATCH_INTERRUPT(FRE)
+	MATCH_INTERRUPT(RST)
+	{
+#if (DEBUG==1)
+		printf("(END)\n");
+#endif
+		encoded[(*size)++]=END;
+	}
+	*size += 2;
+	return 1;
+
+}
+
+uint8_t parse_INT(FILE* fd, byte* encoded, size_t* const size){
+#if (DEBUG==1)
+	printf("INT ");
 #endif
 	encoded[(*size)++] = INT;
 	char c = parse_spaces(fd);
@@ -1362,8 +3169,6 @@ uint8_t parse_label(FILE* fd, char c, byte* encoded, size_t* const size, char* o
 	uint8_t err = 0;
 	*labels = match_label(*labels, label, *size, encoded, &err);
 	assert_return(!err)
-	encoded[(*size)++] = NOP;
-	*size += 3;
 	return 1;
 }
 
@@ -1409,9 +3214,57 @@ uint8_t parse_opcode(FILE* fd, char c, byte* encoded, size_t* const size, label_
 	MATCH_OPCODE(CMP)
 	MATCH_OPCODE(RET)
 	MATCH_OPCODE(INT)
+	MATCH_OPCODE(MCP)
+	MATCH_OPCODE(FIL)
+	MATCH_OPCODE(SCN)
+	MATCH_OPCODE(CPB)
+	MATCH_OPCODE(SLN)
+	MATCH_OPCODE(VLD)
+	MATCH_OPCODE(VST)
+	MATCH_OPCODE(VSP)
+	MATCH_OPCODE(VEX)
+	MATCH_OPCODE(VAD)
+	MATCH_OPCODE(VSB)
+	MATCH_OPCODE(VML)
+	MATCH_OPCODE(VAN)
+	MATCH_OPCODE(VOR)
+	MATCH_OPCODE(VXR)
+	MATCH_OPCODE(VEQ)
+	MATCH_OPCODE(VGT)
+	MATCH_OPCODE(ADC)
+	MATCH_OPCODE(SBC)
+	MATCH_OPCODE(MLW)
+	MATCH_OPCODE(FAD)
+	MATCH_OPCODE(FSB)
+	MATCH_OPCODE(FML)
+	MATCH_OPCODE(FDV)
+	MATCH_OPCODE(FCM)
+	MATCH_OPCODE(ITF)
+	MATCH_OPCODE(FTI)
+	MATCH_OPCODE(CSL)
+	MATCH_OPCODE(JTB)
+	MATCH_OPCODE(RTN)
+	MATCH_OPCODE(PMC)
+	MATCH_OPCODE(HLT)
+	MATCH_OPCODE(IRT)
 	if (strcmp("JMP", op)==0){
 		return parse_JMP(fd, encoded, size, labels);
 	}
+	else if (strcmp("DBN", op)==0){
+		return parse_DBN(fd, encoded, size, labels);
+	}
+	else if (strcmp("CAL", op)==0){
+		return parse_CAL(fd, encoded, size, labels);
+	}
+	else if (strcmp("TCL", op)==0){
+		return parse_TCL(fd, encoded, size, labels);
+	}
+	else if (strcmp("LDA", op)==0){
+		return parse_LDA(fd, encoded, size, labels);
+	}
+	else if (strcmp("JTE", op)==0){
+		return parse_JTE(fd, encoded, size, labels);
+	}
 	else if (strcmp("JSR", op)==0){
 		return parse_JSR(fd, encoded, size, labels);
 	}
@@ -1482,6 +3335,959 @@ uint8_t parse_include(FILE* fd, byte* encoded, size_t* const size, label_assoc**
 	return parse_body(new_fd, encoded, size, label_list);
 }
 
+typedef struct instruction{
+	byte code[4];
+	uint32_t target;
+	uint32_t count;
+	word literal;
+	uint8_t leader;
+	uint8_t removed;
+}instruction;
+
+#define REG_MASK(r) (1<<(r))
+#define ALL_REGISTERS 0xFFFF
+
+uint8_t has_target(instruction* ins){
+	switch (ins->code[0]){
+	case JMP:
+	case JSR:
+	case CAL:
+		return !(ins->code[1] & INDIRECT);
+	case DBN:
+	case LDA:
+	case JTE:
+		return 1;
+	}
+	return 0;
+}
+
+uint8_t branches(instruction* ins){
+	return (ins->code[0] == JMP) || (ins->code[0] == DBN);
+}
+
+uint8_t falls_through(instruction* ins){
+	switch (ins->code[0]){
+	case JMP:
+		return (ins->code[1] & 0xF) != NC;
+	case RET:
+	case RTN:
+	case IRT:
+		return 0;
+	case INT:
+		return ins->code[1] != END;
+	case LAR:
+		return (ins->code[1] & 0xF) != PC;
+	}
+	return 1;
+}
+
+instruction* decode_program(byte* encoded, size_t size, label_assoc* labels, size_t* count){
+	*count = size/4;
+	instruction* prog = calloc(*count+1, sizeof(instruction));
+	for (size_t i = 0;i<*count;++i){
+		memcpy(prog[i].code, encoded+(i*4), 4);
+		if (prog[i].code[0] == LDC){
+			prog[i].literal = constant_pool[(prog[i].code[2]<<8) | prog[i].code[3]];
+		}
+	}
+	for (label_assoc* head = labels;head != NULL;head = head->next){
+		if (head->tag == LABEL_MATCH && head->v/4 < *count){
+			prog[head->v/4].leader = 1;
+		}
+	}
+	for (size_t i = 0;i<*count;++i){
+		if (!has_target(&prog[i])){
+			continue;
+		}
+		prog[i].target = ((prog[i].code[2]<<8) | prog[i].code[3])/4;
+		if (prog[i].target < *count){
+			prog[prog[i].target].leader = 1;
+		}
+	}
+	return prog;
+}
+
+void compact_program(instruction* prog, size_t* count){
+	uint32_t* index = malloc(sizeof(uint32_t)*(*count+1));
+	size_t kept = 0;
+	uint8_t leader = 0;
+	uint32_t hits = 0;
+	for (size_t i = 0;i<*count;++i){
+		index[i] = kept;
+		if (prog[i].removed){
+			leader |= prog[i].leader;
+			hits = prog[i].count > hits ? prog[i].count : hits;
+			continue;
+		}
+		prog[kept] = prog[i];
+		prog[kept].leader |= leader;
+		prog[kept].count = hits > prog[kept].count ? hits : prog[kept].count;
+		leader = 0;
+		hits = 0;
+		kept += 1;
+	}
+	index[*count] = kept;
+	for (size_t i = 0;i<kept;++i){
+		if (has_target(&prog[i])){
+			prog[i].target = index[prog[i].target];
+		}
+	}
+	*count = kept;
+	free(index);
+}
+
+size_t pool_slot(size_t* pool, word value){
+	size_t slot = 0;
+	while (slot < *pool && constant_pool[slot] != value){
+		slot += 1;
+	}
+	if (slot == *pool){
+		constant_pool[(*pool)++] = value;
+	}
+	return slot;
+}
+
+uint8_t reaches_end(instruction* prog, size_t count){
+	if (count == 0 || falls_through(&prog[count-1])){
+		return 1;
+	}
+	for (size_t i = 0;i<count;++i){
+		if (has_target(&prog[i]) && prog[i].target == count){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+size_t encode_program(instruction* prog, size_t count, byte* encoded){
+	uint8_t constants = 0;
+	for (size_t i = 0;i<count;++i){
+		constants |= prog[i].code[0] == LDC;
+	}
+	size_t start = (constants && reaches_end(prog, count)) ? count+POOL_GUARD : count;
+	size_t pool = 0;
+	for (size_t i = 0;i<count;++i){
+		if (has_target(&prog[i])){
+			prog[i].code[2] = ((prog[i].target*4) >> 8) & 0xFF;
+			prog[i].code[3] = (prog[i].target*4) & 0xFF;
+		}
+		if (prog[i].code[0] == LDC){
+			word offset = start+pool_slot(&pool, prog[i].literal)-i;
+			assert_return(offset <= 0xFFFF)
+			prog[i].code[2] = (offset >> 8) & 0xFF;
+			prog[i].code[3] = offset & 0xFF;
+		}
+		memcpy(encoded+(i*4), prog[i].code, 4);
+	}
+	if (start != count){
+		word offset = start+pool_slot(&pool, PROG_END)-count;
+		byte load[4] = {LDC, R0, (offset >> 8) & 0xFF, offset & 0xFF};
+		byte jump[4] = {JMP, NC | INDIRECT, R0, 0};
+		memcpy(encoded+(count*4), load, 4);
+		memcpy(encoded+((count+1)*4), jump, 4);
+	}
+	for (size_t slot = 0;slot<pool;++slot){
+		WRITE_BYTES(encoded, (start+slot)*4, constant_pool[slot])
+	}
+	return (start+pool)*4;
+}
+
+uint16_t instruction_reads(instruction* ins){
+	byte a = ins->code[1];
+	switch (ins->code[0]){
+	case INT:
+		if (find_host_call(a) != NULL && find_host_call(a)->pure){
+			return find_host_call(a)->reads;
+		}
+		return ALL_REGISTERS;
+	case NOP:
+	case LDC:
+		return 0;
+	case LDW:
+	case LDB:
+		switch (a>>6){
+		case 0: return REG_MASK(a & 0x7) | REG_MASK(ins->code[2] & 0x7);
+		case 1: return REG_MASK(a & 0x7);
+		}
+		return 0;
+	case STR:
+	case STB:
+		switch (a>>6){
+		case 0: return REG_MASK((a>>3) & 0x7) | REG_MASK(a & 0x7) | REG_MASK(ins->code[2] & 0x7);
+		case 1: return REG_MASK((a>>3) & 0x7) | REG_MASK(a & 0x7);
+		}
+		return REG_MASK((a>>3) & 0x7);
+	case LAR:
+		return REG_MASK(ins->code[2] & 0xF);
+	case ADD: case SUB: case MUL: case DIV: case MOD:
+	case LSL: case LSR: case AND: case ORR: case XOR:
+		if (a>>6){
+			return REG_MASK(a & 0x7);
+		}
+		return REG_MASK(a & 0x7) | REG_MASK(ins->code[2] & 0x7);
+	case ADC: case SBC:
+		if (a>>6){
+			return REG_MASK(a & 0x7) | REG_MASK(SR);
+		}
+		return REG_MASK(a & 0x7) | REG_MASK(ins->code[2] & 0x7) | REG_MASK(SR);
+	case MLW:
+		return REG_MASK(a & 0x7) | REG_MASK(ins->code[2] & 0x7);
+	case COM:
+		if (a>>3){
+			return 0;
+		}
+		return REG_MASK(ins->code[2] & 0x7);
+	case PSH:
+		if (a > 3){
+			return REG_MASK(a & 0x7) | REG_MASK(ST);
+		}
+		return REG_MASK(ST);
+	case POP:
+		return REG_MASK(ST);
+	case CMP:
+		return REG_MASK(a & 0x7) | REG_MASK(ins->code[2] & 0x7);
+	case JMP:
+		if ((a & 0xF) == NC){
+			return (a & INDIRECT) ? REG_MASK(ins->code[2] & 0x7) : 0;
+		}
+		return (a & INDIRECT) ? REG_MASK(ins->code[2] & 0x7) | REG_MASK(SR) : REG_MASK(SR);
+	case LDA:
+	case JTE:
+	case PMC:
+		return 0;
+	case JTB:
+		return REG_MASK(a & 0x7);
+	case MCP:
+	case FIL:
+	case SCN:
+	case CPB:
+		return REG_MASK(a & 0x7) | REG_MASK(ins->code[2] & 0x7) | REG_MASK(ins->code[3] & 0x7);
+	case SLN:
+	case VLD:
+	case VST:
+	case VSP:
+	case ITF:
+	case FTI:
+		return REG_MASK(ins->code[2] & 0x7);
+	case FAD: case FSB: case FML: case FDV:
+		return REG_MASK(ins->code[2] & 0x7) | REG_MASK(ins->code[3] & 0x7);
+	case FCM:
+		return REG_MASK(a & 0x7) | REG_MASK(ins->code[2] & 0x7);
+	case DBN:
+		return REG_MASK(a & 0x7);
+	case CSL:
+		return REG_MASK(ins->code[2] & 0x7) | REG_MASK(ins->code[3] & 0x7) | REG_MASK(SR);
+	case VEX: case VAD: case VSB: case VML:
+	case VAN: case VOR: case VXR: case VEQ: case VGT:
+		return 0;
+	}
+	return ALL_REGISTERS;
+}
+
+uint16_t instruction_writes(instruction* ins){
+	byte a = ins->code[1];
+	switch (ins->code[0]){
+	case INT:
+		if (find_host_call(a) != NULL && find_host_call(a)->pure){
+			return find_host_call(a)->writes;
+		}
+		return ALL_REGISTERS;
+	case NOP:
+	case STR:
+	case STB:
+	case JMP:
+	case JTB:
+	case JTE:
+		return 0;
+	case LDA:
+		return REG_MASK(a & 0x7);
+	case LDW:
+	case LDB:
+		return REG_MASK((a>>3) & 0x7);
+	case LDC:
+		return REG_MASK(a & 0x7);
+	case LAR:
+		return REG_MASK(a & 0xF);
+	case ADD: case SUB: case MUL: case DIV: case MOD:
+	case LSL: case LSR: case AND: case ORR: case XOR:
+	case ADC: case SBC:
+		return REG_MASK((a>>3) & 0x7) | REG_MASK(SR);
+	case MLW:
+		return REG_MASK((a>>3) & 0x7) | REG_MASK(ins->code[3] & 0x7) | REG_MASK(SR);
+	case PMC:
+		return REG_MASK((a>>3) & 0x7) | REG_MASK(a & 0x7);
+	case COM:
+		return REG_MASK(a & 0x7) | REG_MASK(SR);
+	case PSH:
+		return REG_MASK(ST);
+	case POP:
+		return REG_MASK(a & 0x7) | REG_MASK(ST);
+	case CMP:
+	case MCP:
+	case FIL:
+	case CPB:
+	case FCM:
+		return REG_MASK(SR);
+	case FAD: case FSB: case FML: case FDV:
+	case ITF: case FTI: case DBN:
+		return REG_MASK(a & 0x7);
+	case CSL:
+		return REG_MASK((a>>4) & 0x7);
+	case SCN:
+	case SLN:
+		return REG_MASK(a & 0x7) | REG_MASK(SR);
+	case VEX:
+		return REG_MASK((a>>3) & 0x7);
+	case VLD: case VST: case VSP: case VAD: case VSB:
+	case VML: case VAN: case VOR: case VXR: case VEQ: case VGT:
+		return 0;
+	}
+	return ALL_REGISTERS;
+}
+
+uint8_t register_dead_after(instruction* prog, size_t count, size_t i, byte r){
+	for (size_t k = i+1;k<count;++k){
+		if (prog[k].code[0] == INT && prog[k].code[1] == END){
+			return r != R0;
+		}
+		if (instruction_reads(&prog[k]) & REG_MASK(r)){
+			return 0;
+		}
+		if (instruction_writes(&prog[k]) & REG_MASK(r)){
+			return 1;
+		}
+		if (has_target(&prog[k]) || !falls_through(&prog[k])){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+uint8_t identity_alu(instruction* ins){
+	byte a = ins->code[1];
+	if ((a>>6) == 0 || ((a>>3) & 0x7) != (a & 0x7)){
+		return 0;
+	}
+	word val = (ins->code[2]<<8) | ins->code[3];
+	switch (ins->code[0]){
+	case ADD: case SUB: case LSL: case LSR: case ORR: case XOR:
+		return val == 0;
+	case MUL: case DIV:
+		return val == 1;
+	}
+	return 0;
+}
+
+typedef struct known_value{
+	enum{VALUE_NONE, VALUE_CONST, VALUE_AUX} tag;
+	word v;
+}known_value;
+
+uint8_t peephole_pass(instruction* prog, size_t count){
+	uint8_t changed = 0;
+	known_value known[8] = {0};
+	for (size_t i = 0;i<count;++i){
+		instruction* ins = &prog[i];
+		instruction* next = (i+1<count) ? &prog[i+1] : NULL;
+		if (ins->leader){
+			memset(known, 0, sizeof(known));
+		}
+		if (ins->code[0] == JMP && has_target(ins) && ins->target == i+1){
+			ins->removed = 1;
+			changed = 1;
+			continue;
+		}
+		if (identity_alu(ins) && register_dead_after(prog, count, i, SR)){
+			ins->removed = 1;
+			changed = 1;
+			continue;
+		}
+		if (ins->code[0] == PSH && next != NULL && next->code[0] == POP && !next->leader){
+			byte dst = next->code[1] & 0x7;
+			if (ins->code[1] > 3 && (ins->code[1] & 0x7) == dst){
+				ins->removed = 1;
+				next->removed = 1;
+			}
+			else if (ins->code[1] > 3){
+				byte replace[4] = {LAR, dst, ins->code[1] & 0x7, 0};
+				memcpy(ins->code, replace, 4);
+				next->removed = 1;
+			}
+			else{
+				byte replace[4] = {LDW, (0x3<<6) | (dst<<3), ins->code[2], ins->code[3]};
+				memcpy(ins->code, replace, 4);
+				next->removed = 1;
+			}
+			changed = 1;
+			i += 1;
+			memset(known, 0, sizeof(known));
+			continue;
+		}
+		known_value value = {VALUE_NONE, 0};
+		byte dst = 0;
+		if (ins->code[0] == LDW && (ins->code[1]>>6) == 0x3){
+			dst = (ins->code[1]>>3) & 0x7;
+			value.tag = VALUE_CONST;
+			value.v = (ins->code[2]<<8) | ins->code[3];
+		}
+		else if (ins->code[0] == LDC){
+			dst = ins->code[1] & 0x7;
+			value.tag = VALUE_CONST;
+			value.v = ins->literal;
+		}
+		else if (ins->code[0] == LAR && ins->code[1] < 8 && ins->code[2] >= ST && ins->code[2] != PC){
+			dst = ins->code[1];
+			value.tag = VALUE_AUX;
+			value.v = ins->code[2];
+		}
+		if (value.tag != VALUE_NONE && known[dst].tag == value.tag && known[dst].v == value.v){
+			ins->removed = 1;
+			changed = 1;
+			continue;
+		}
+		uint16_t writes = instruction_writes(ins);
+		for (byte r = 0;r<8;++r){
+			if ((writes & REG_MASK(r))
+			 || (known[r].tag == VALUE_AUX && (writes & REG_MASK(known[r].v)))){
+				known[r].tag = VALUE_NONE;
+			}
+		}
+		if (value.tag != VALUE_NONE){
+			known[dst] = value;
+		}
+		if (has_target(ins) || !falls_through(ins)){
+			memset(known, 0, sizeof(known));
+		}
+	}
+	return changed;
+}
+
+void peephole(instruction* prog, size_t* count){
+	size_t before = *count;
+	while (peephole_pass(prog, *count)){
+		compact_program(prog, count);
+	}
+	printf("optimizer: %lu -> %lu instructions\n", before, *count);
+}
+
+#define INLINE_LIMIT 16
+
+typedef struct leaf_procedure{
+	size_t body;
+	size_t ret;
+	uint8_t framed;
+	byte frame;
+}leaf_procedure;
+
+uint8_t inline_safe(instruction* ins){
+	switch (ins->code[0]){
+	case NOP: case LDW: case LDB: case LDC: case STR: case STB:
+	case ADD: case SUB: case MUL: case DIV: case MOD:
+	case LSL: case LSR: case AND: case ORR: case XOR:
+	case COM: case CMP: case MCP: case FIL:
+	case SCN: case CPB: case SLN:
+	case VLD: case VST: case VSP: case VEX: case VAD: case VSB:
+	case VML: case VAN: case VOR: case VXR: case VEQ: case VGT:
+	case ADC: case SBC: case MLW:
+	case FAD: case FSB: case FML: case FDV:
+	case FCM: case ITF: case FTI: case CSL:
+	case PMC:
+		return 1;
+	case LAR:
+		return ins->code[2] != ST && ins->code[2] != FP && ins->code[2] != PC;
+	}
+	return 0;
+}
+
+uint8_t leaf_candidate(instruction* prog, size_t count, size_t entry, leaf_procedure* leaf){
+	size_t k = entry;
+	for (;k<count && k-entry < INLINE_LIMIT;++k){
+		if (k != entry && prog[k].leader){
+			return 0;
+		}
+		if (prog[k].code[0] == RET || prog[k].code[0] == RTN){
+			break;
+		}
+	}
+	if (k < count && prog[k].code[0] == RTN && k != entry){
+		leaf->ret = k;
+		leaf->body = entry;
+		leaf->framed = 0;
+		for (k = entry;k<leaf->ret;++k){
+			if (!inline_safe(&prog[k])){
+				return 0;
+			}
+		}
+		return 1;
+	}
+	if (k >= count || prog[k].code[0] != RET || k == entry || prog[k-1].code[0] != PSH){
+		return 0;
+	}
+	leaf->ret = k;
+	leaf->body = entry;
+	leaf->framed = 0;
+	instruction* lar = &prog[entry];
+	instruction* add = &prog[entry+1];
+	if (lar->code[0] == LAR && lar->code[2] == FP && lar->code[1] < 8
+	 && add->code[0] == ADD && add->code[1] == ((1<<6) | (lar->code[1]<<3) | lar->code[1])
+	 && add->code[2] == 0 && add->code[3] == 1){
+		leaf->framed = 1;
+		leaf->frame = lar->code[1];
+		leaf->body = entry+2;
+	}
+	for (k = leaf->body;k<leaf->ret-1;++k){
+		if (!inline_safe(&prog[k])){
+			return 0;
+		}
+		if (!leaf->framed){
+			continue;
+		}
+		if (instruction_writes(&prog[k]) & REG_MASK(leaf->frame)){
+			return 0;
+		}
+		uint8_t frame_load = (prog[k].code[0] == LDW)
+			&& ((prog[k].code[1]>>6) == 1)
+			&& ((prog[k].code[1] & 0x7) == leaf->frame);
+		if (!frame_load && (instruction_reads(&prog[k]) & REG_MASK(leaf->frame))){
+			return 0;
+		}
+	}
+	instruction* ret = &prog[leaf->ret-1];
+	return !(leaf->framed && ret->code[1] > 3 && (ret->code[1] & 0x7) == leaf->frame);
+}
+
+uint8_t argument_push(instruction* prog, size_t site, word offset, instruction** push){
+	if (offset < 8 || (offset-8) % 4 != 0){
+		return 0;
+	}
+	size_t slot = (offset-8)/4;
+	if (slot >= site){
+		return 0;
+	}
+	for (size_t k = site-1-slot;k<=site;++k){
+		if (prog[k].code[0] != PSH && k != site){
+			return 0;
+		}
+		if (k != site-1-slot && prog[k].leader){
+			return 0;
+		}
+	}
+	*push = &prog[site-1-slot];
+	return 1;
+}
+
+uint8_t forward_frame_load(instruction* prog, size_t site, leaf_procedure* leaf, size_t k, uint16_t written, instruction* ins){
+	instruction* push = NULL;
+	uint8_t frame_load = leaf->framed && k != leaf->ret-1 && ins->code[0] == LDW
+		&& ((ins->code[1]>>6) == 1) && ((ins->code[1] & 0x7) == leaf->frame);
+	if (!frame_load){
+		return 1;
+	}
+	if (!argument_push(prog, site, (ins->code[2]<<8) | ins->code[3], &push)){
+		return 0;
+	}
+	byte dst = (ins->code[1]>>3) & 0x7;
+	if (push->code[1] <= 3){
+		byte load[4] = {LDW, (0x3<<6) | (dst<<3), push->code[2], push->code[3]};
+		memcpy(ins->code, load, 4);
+		return 1;
+	}
+	if (!(written & REG_MASK(push->code[1] & 0x7))){
+		byte move[4] = {LAR, dst, push->code[1] & 0x7, 0};
+		memcpy(ins->code, move, 4);
+		return 1;
+	}
+	return 0;
+}
+
+size_t inline_site(instruction* prog, size_t count, size_t site, leaf_procedure* leaf, instruction* out){
+	size_t n = 0;
+	uint8_t keep_frame = 0;
+	if (leaf->framed){
+		keep_frame = !register_dead_after(prog, count, site, leaf->frame);
+		uint8_t flags_set = 0;
+		for (size_t k = leaf->body;k<leaf->ret-1;++k){
+			if (instruction_reads(&prog[k]) & REG_MASK(SR)){
+				keep_frame = 1;
+				break;
+			}
+			if (instruction_writes(&prog[k]) & REG_MASK(SR)){
+				flags_set = 1;
+				break;
+			}
+		}
+		keep_frame |= !flags_set && !register_dead_after(prog, count, site, SR);
+		uint16_t written = 0;
+		for (size_t k = leaf->body;k<leaf->ret && !keep_frame;++k){
+			instruction ins = prog[k];
+			keep_frame = !forward_frame_load(prog, site, leaf, k, written, &ins);
+			written |= instruction_writes(&ins);
+		}
+	}
+	if (keep_frame){
+		byte lar[4] = {LAR, leaf->frame, ST, 0};
+		byte sub[4] = {SUB, (1<<6) | (leaf->frame<<3) | leaf->frame, 0, 7};
+		memset(&out[n], 0, 2*sizeof(instruction));
+		memcpy(out[n++].code, lar, 4);
+		memcpy(out[n++].code, sub, 4);
+	}
+	uint16_t written = keep_frame ? REG_MASK(leaf->frame) : 0;
+	for (size_t k = leaf->body;k<leaf->ret;++k){
+		instruction ins = prog[k];
+		ins.leader = 0;
+		forward_frame_load(prog, site, leaf, k, written, &ins);
+		written |= instruction_writes(&ins);
+		out[n++] = ins;
+	}
+	out[0].leader = prog[site].leader;
+	return n;
+}
+
+uint8_t inline_call(instruction* prog, size_t count, size_t site, leaf_procedure* leaf){
+	instruction* call = &prog[site];
+	if (!has_target(call)){
+		return 0;
+	}
+	if (call->code[0] == JSR && (call->code[1] & 0xF) == NC){
+		return leaf_candidate(prog, count, call->target, leaf) && prog[leaf->ret].code[0] == RET;
+	}
+	if (call->code[0] == CAL){
+		return leaf_candidate(prog, count, call->target, leaf) && prog[leaf->ret].code[0] == RTN;
+	}
+	return 0;
+}
+
+instruction* inline_procedures(instruction* prog, size_t* count){
+	size_t total = 0;
+	leaf_procedure leaf;
+	for (size_t i = 0;i<*count;++i){
+		total += 1;
+		if (inline_call(prog, *count, i, &leaf)){
+			total += 2+leaf.ret-leaf.body;
+		}
+	}
+	instruction* out = calloc(total+1, sizeof(instruction));
+	uint32_t* index = malloc(sizeof(uint32_t)*(*count+1));
+	size_t n = 0;
+	size_t inlined = 0;
+	for (size_t i = 0;i<*count;++i){
+		index[i] = n;
+		if (inline_call(prog, *count, i, &leaf)){
+			n += inline_site(prog, *count, i, &leaf, out+n);
+			inlined += 1;
+			continue;
+		}
+		out[n++] = prog[i];
+	}
+	index[*count] = n;
+	for (size_t i = 0;i<n;++i){
+		if (has_target(&out[i])){
+			out[i].target = index[out[i].target];
+		}
+	}
+	printf("inliner: %lu call sites inlined\n", inlined);
+	free(index);
+	free(prog);
+	*count = n;
+	return out;
+}
+
+void permute_program(instruction* prog, size_t count, uint32_t* order){
+	instruction* copy = malloc(sizeof(instruction)*(count+1));
+	uint32_t* index = malloc(sizeof(uint32_t)*(count+1));
+	memcpy(copy, prog, sizeof(instruction)*count);
+	for (size_t i = 0;i<count;++i){
+		index[order[i]] = i;
+		prog[i] = copy[order[i]];
+	}
+	index[count] = count;
+	for (size_t i = 0;i<count;++i){
+		if (has_target(&prog[i])){
+			prog[i].target = index[prog[i].target];
+		}
+	}
+	free(index);
+	free(copy);
+}
+
+void hoist_entry(instruction* prog, size_t* count){
+	if (*count == 0 || prog[0].code[0] != JMP || !has_target(&prog[0]) || (prog[0].code[1] & 0xF) != NC){
+		return;
+	}
+	size_t start = prog[0].target;
+	if (start == 0 || start >= *count || falls_through(&prog[start-1])){
+		return;
+	}
+	size_t end = start;
+	while (end < *count && falls_through(&prog[end])){
+		end += 1;
+	}
+	if (end == *count){
+		return;
+	}
+	uint32_t* order = malloc(sizeof(uint32_t)*(*count));
+	size_t n = 0;
+	order[n++] = 0;
+	for (size_t i = start;i<=end;++i){
+		order[n++] = i;
+	}
+	for (size_t i = 1;i<start;++i){
+		order[n++] = i;
+	}
+	for (size_t i = end+1;i<*count;++i){
+		order[n++] = i;
+	}
+	permute_program(prog, *count, order);
+	prog[0].removed = 1;
+	compact_program(prog, count);
+	free(order);
+}
+
+void eliminate_dead_code(instruction* prog, size_t* count){
+	size_t before = *count;
+	if (*count == 0){
+		return;
+	}
+	uint8_t* reachable = calloc(*count+1, sizeof(uint8_t));
+	uint32_t* work = malloc(sizeof(uint32_t)*(*count+1));
+	size_t pending = 0;
+	reachable[0] = 1;
+	work[pending++] = 0;
+	while (pending){
+		size_t i = work[--pending];
+		uint32_t next[2];
+		uint8_t edges = 0;
+		if (has_target(&prog[i])){
+			next[edges++] = prog[i].target;
+		}
+		if (falls_through(&prog[i])){
+			next[edges++] = i+1;
+		}
+		for (uint8_t e = 0;e<edges;++e){
+			if (next[e] < *count && !reachable[next[e]]){
+				reachable[next[e]] = 1;
+				work[pending++] = next[e];
+			}
+		}
+	}
+	for (size_t i = 0;i<*count;++i){
+		prog[i].removed = !reachable[i];
+	}
+	compact_program(prog, count);
+	hoist_entry(prog, count);
+	printf("dead code: %lu -> %lu instructions\n", before, *count);
+	free(work);
+	free(reachable);
+}
+
+uint8_t load_profile(FILE* fd, instruction* prog, size_t count, label_assoc* labels, uint32_t* hits){
+	char key[16];
+	uint32_t n;
+	while (fscanf(fd, "%15s %u", key, &n) == 2){
+		if (key[0] == 'x'){
+			word address = strtol(key+1, NULL, 16);
+			if (address/4 < PROG_SIZE/4){
+				hits[address/4] = n;
+			}
+			continue;
+		}
+		for (label_assoc* head = labels;head != NULL;head = head->next){
+			if (head->tag == LABEL_MATCH && strcmp(head->k, key)==0 && head->v/4 < count){
+				prog[head->v/4].count = n;
+				break;
+			}
+		}
+	}
+	fclose(fd);
+	return 1;
+}
+
+byte invert_metric(byte metric){
+	switch (metric){
+	case EQ: return NE;
+	case NE: return EQ;
+	case LT: return GT;
+	case LE: return GT;
+	case GT: return LT;
+	case CS: return CC;
+	case CC: return CS;
+	case VS: return VC;
+	case VC: return VS;
+	}
+	return NC;
+}
+
+typedef struct block{
+	uint32_t start;
+	uint32_t end;
+	uint32_t fall;
+	uint32_t jump;
+	uint32_t chain;
+	uint32_t next;
+	uint32_t count;
+}block;
+
+#define NO_BLOCK 0xFFFFFFFF
+
+typedef struct layout_edge{
+	uint32_t from;
+	uint32_t to;
+	uint32_t weight;
+	uint32_t order;
+}layout_edge;
+
+int compare_edges(const void* a, const void* b){
+	const layout_edge* x = a;
+	const layout_edge* y = b;
+	if (x->weight != y->weight){
+		return x->weight < y->weight ? 1 : -1;
+	}
+	return x->order < y->order ? -1 : (x->order > y->order);
+}
+
+uint8_t ends_block(instruction* ins){
+	return branches(ins) || !falls_through(ins);
+}
+
+instruction* layout_program(instruction* prog, size_t* count){
+	size_t count_in = *count;
+	block* blocks = malloc(sizeof(block)*(count_in+1));
+	uint32_t* owner = malloc(sizeof(uint32_t)*(count_in+1));
+	size_t nblocks = 0;
+	for (size_t i = 0;i<count_in;++i){
+		if (i == 0 || prog[i].leader || ends_block(&prog[i-1])){
+			blocks[nblocks].start = i;
+			blocks[nblocks].count = prog[i].count;
+			nblocks += 1;
+		}
+		owner[i] = nblocks-1;
+		blocks[nblocks-1].end = i;
+	}
+	owner[count_in] = NO_BLOCK;
+	layout_edge* edges = malloc(sizeof(layout_edge)*(2*nblocks+1));
+	size_t nedges = 0;
+	for (size_t b = 0;b<nblocks;++b){
+		instruction* last = &prog[blocks[b].end];
+		blocks[b].chain = b;
+		blocks[b].next = NO_BLOCK;
+		blocks[b].fall = falls_through(last) ? owner[blocks[b].end+1] : NO_BLOCK;
+		blocks[b].jump = (branches(last) && has_target(last)) ? owner[last->target] : NO_BLOCK;
+		uint32_t targets[2] = {blocks[b].fall, NO_BLOCK};
+		if (last->code[0] == JMP && has_target(last) && ((last->code[1] & 0xF) == NC || invert_metric(last->code[1] & 0xF) != NC)){
+			targets[1] = blocks[b].jump;
+		}
+		for (uint8_t e = 0;e<2;++e){
+			uint32_t to = targets[e];
+			if (to == NO_BLOCK || to == 0){
+				continue;
+			}
+			edges[nedges].from = b;
+			edges[nedges].to = to;
+			edges[nedges].weight = blocks[b].count < blocks[to].count ? blocks[b].count : blocks[to].count;
+			edges[nedges].order = (b*2)+e;
+			nedges += 1;
+		}
+	}
+	qsort(edges, nedges, sizeof(layout_edge), compare_edges);
+	uint32_t* tail = malloc(sizeof(uint32_t)*nblocks);
+	for (size_t b = 0;b<nblocks;++b){
+		tail[b] = b;
+	}
+	for (size_t e = 0;e<nedges;++e){
+		uint32_t from = edges[e].from;
+		uint32_t to = edges[e].to;
+		uint32_t head = blocks[from].chain;
+		if (tail[head] != from || blocks[to].chain != to || head == to){
+			continue;
+		}
+		blocks[from].next = to;
+		tail[head] = tail[to];
+		for (uint32_t k = to;k != NO_BLOCK;k = blocks[k].next){
+			blocks[k].chain = head;
+		}
+	}
+	uint32_t* heat = calloc(nblocks, sizeof(uint32_t));
+	for (size_t b = 0;b<nblocks;++b){
+		if (blocks[b].count > heat[blocks[b].chain]){
+			heat[blocks[b].chain] = blocks[b].count;
+		}
+	}
+	uint32_t* chains = malloc(sizeof(uint32_t)*nblocks);
+	size_t nchains = 0;
+	for (size_t b = 1;b<nblocks;++b){
+		if (blocks[b].chain == b){
+			chains[nchains++] = b;
+		}
+	}
+	for (size_t i = 1;i<nchains;++i){
+		uint32_t c = chains[i];
+		size_t k = i;
+		for (;k>0 && heat[chains[k-1]] < heat[c];--k){
+			chains[k] = chains[k-1];
+		}
+		chains[k] = c;
+	}
+	uint32_t* order = malloc(sizeof(uint32_t)*nblocks);
+	size_t n = 0;
+	for (uint32_t k = 0;k != NO_BLOCK;k = blocks[k].next){
+		order[n++] = k;
+	}
+	for (size_t c = 0;c<nchains;++c){
+		for (uint32_t k = chains[c];k != NO_BLOCK;k = blocks[k].next){
+			order[n++] = k;
+		}
+	}
+	instruction* out = calloc(count_in+nblocks+1, sizeof(instruction));
+	uint32_t* index = malloc(sizeof(uint32_t)*(count_in+1));
+	size_t emitted = 0;
+	for (size_t o = 0;o<n;++o){
+		block* b = &blocks[order[o]];
+		uint32_t following = (o+1<n) ? order[o+1] : NO_BLOCK;
+		instruction* last = &prog[b->end];
+		for (uint32_t i = b->start;i<b->end;++i){
+			index[i] = emitted;
+			out[emitted++] = prog[i];
+		}
+		index[b->end] = emitted;
+		if (last->code[0] == JMP && has_target(last) && (last->code[1] & 0xF) == NC && b->jump == following){
+			continue;
+		}
+		out[emitted] = *last;
+		if (last->code[0] == JMP && has_target(last) && b->fall != NO_BLOCK && b->fall != following && b->jump == following
+		 && invert_metric(last->code[1] & 0xF) != NC){
+			out[emitted].code[1] = invert_metric(last->code[1] & 0xF);
+			out[emitted].target = blocks[b->fall].start;
+			emitted += 1;
+			continue;
+		}
+		emitted += 1;
+		if (falls_through(last) && b->fall != following){
+			byte jump[4] = {JMP, NC, 0, 0};
+			memcpy(out[emitted].code, jump, 4);
+			out[emitted].target = (b->fall == NO_BLOCK) ? count_in : blocks[b->fall].start;
+			emitted += 1;
+		}
+	}
+	index[count_in] = emitted;
+	for (size_t i = 0;i<emitted;++i){
+		if (has_target(&out[i])){
+			out[i].target = index[out[i].target];
+		}
+	}
+	printf("layout: %lu blocks, %lu -> %lu instructions\n", nblocks, count_in, emitted);
+	*count = emitted;
+	free(index);
+	free(order);
+	free(chains);
+	free(heat);
+	free(tail);
+	free(edges);
+	free(owner);
+	free(blocks);
+	free(prog);
+	return out;
+}
+
 uint8_t assembler(int32_t argc, char** argv){
 #if (DEBUG==1)
 	printf("Assembler symbols:\n");
@@ -1492,8 +4298,56 @@ uint8_t assembler(int32_t argc, char** argv){
 	byte encoded[PROG_SIZE] = {0};
 	label_assoc* label_list = NULL;
 	size_t size = 0;
+	uint8_t optimize = 0;
+	uint8_t inline_leaves = 0;
+	uint8_t strip = 0;
+	FILE* profile = NULL;
+	for (int32_t i = 5;i<argc;++i){
+		if (strcmp(argv[i], "-O")==0){
+			optimize = 1;
+		}
+		else if (strcmp(argv[i], "-i")==0){
+			inline_leaves = 1;
+		}
+		else if (strcmp(argv[i], "-d")==0){
+			strip = 1;
+		}
+		else if (strcmp(argv[i], "-p")==0 && i+1<argc){
+			profile = fopen(argv[++i], "r");
+			assert_return(profile!=NULL)
+		}
+		else if (strcmp(argv[i], "-l")==0 && i+1<argc){
+			assert_return(load_host_calls(argv[++i]))
+		}
+	}
 	parse_body(fd, encoded, &size, &label_list);
+	size_t count = 0;
+	instruction* prog = decode_program(encoded, size, label_list, &count);
+	uint32_t* hits = NULL;
+	if (profile != NULL){
+		hits = calloc(PROG_SIZE/4, sizeof(uint32_t));
+		load_profile(profile, prog, count, label_list, hits);
+	}
 	free_label_assoc(label_list);
+	if (inline_leaves){
+		prog = inline_procedures(prog, &count);
+	}
+	if (optimize){
+		peephole(prog, &count);
+	}
+	if (strip){
+		eliminate_dead_code(prog, &count);
+	}
+	if (hits != NULL){
+		for (size_t i = 0;i<count;++i){
+			prog[i].count = hits[i] > prog[i].count ? hits[i] : prog[i].count;
+		}
+		prog = layout_program(prog, &count);
+		free(hits);
+	}
+	size = encode_program(prog, count, encoded);
+	assert_return(size != 0 || count == 0)
+	free(prog);
 	for (size_t i = 0;i<size;++i){
 		printf("%.2x ", encoded[i]);
 		if (i%4 == 3){
@@ -1505,6 +4359,7 @@ uint8_t assembler(int32_t argc, char** argv){
 	assert_return(outfile!=NULL)
 	fwrite(encoded, 1, size, outfile);
 	fclose(outfile);
+	return 1;
 }
 
 uint8_t setup_devices(){
@@ -1512,35 +4367,352 @@ uint8_t setup_devices(){
 	for (int i = 0;i<DEV_COUNT;++i){
 		word device_ptr = PROG_END+(i*DEV_SIZE);
 		word size = 0;
+		device* dev = &devices[device_count];
+		memset(dev, 0, sizeof(device));
 		switch (device_config[i].type){
 		case DEV_NONE:
 		default:
-			return;
+			return 1;
 		case DEV_SCREEN:
-			size = device_config[i].data.screen.w*device_config[i].data.screen.h;
+			dev->width = device_config[i].data.screen.w;
+			dev->height = device_config[i].data.screen.h;
+			size = dev->width*dev->height;
+			if (size != 0){
+				dev->dirty = calloc(dev->height, sizeof(atomic_uchar));
+			}
+			break;
 		case DEV_KEYBOARD:
 			size = device_config[i].data.keyboard.keys;
+			break;
 		case DEV_MOUSE:
-			size = 8;
+			size = RING_HEADER+(MOUSE_EVENTS*4);
+			break;
+		case DEV_TIMER:
+			size = TIMER_SIZE;
+			break;
+		case DEV_DMA:
+			size = DMA_SIZE;
+			break;
+		case DEV_BLOCK:
+			host_page = sysconf(_SC_PAGESIZE);
+			address += (host_page-((uintptr_t)(ram+address) % host_page)) % host_page;
+			size = BLOCK_WINDOW;
+			if (block_device == NULL){
+				block_device = dev;
+			}
+			break;
 		}
+		assert_return(address < DEV_POINTER)
 		assert_return(address + size < MEM_SIZE)
 		WRITE(device_ptr, size)
 		word location = address | (device_config[i].type << 24);
 		WRITE(device_ptr+4, location)
+		dev->type = device_config[i].type;
+		dev->start = address;
+		dev->size = size;
+		device_count += 1;
 		address += size;
 	}
+	return 1;
+}
+
+/* Timer layout
+ * Period in microseconds (Word), 0 stops the timer
+ * Vector raised on each expiry (Word)
+ */
+static atomic_uchar timing;
+static pthread_t timer_thread;
+
+void add_microseconds(struct timespec* t, word us){
+	t->tv_sec += us/1000000;
+	t->tv_nsec += (long)(us%1000000)*1000;
+	if (t->tv_nsec >= 1000000000){
+		t->tv_sec += 1;
+		t->tv_nsec -= 1000000000;
+	}
+}
+
+uint8_t time_before(struct timespec* a, struct timespec* b){
+	return (a->tv_sec < b->tv_sec) || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+void* run_timer(void* arg){
+	uint8_t active = 0;
+	struct timespec next;
+	struct timespec now;
+	pthread_mutex_lock(&timer_lock);
+	while (atomic_load(&timing)){
+		word period = timer_period;
+		if (period == 0){
+			if (active){
+				active = 0;
+				remove_event_source();
+			}
+			pthread_cond_wait(&timer_signal, &timer_lock);
+			continue;
+		}
+		if (!active){
+			active = 1;
+			atomic_fetch_add(&event_sources, 1);
+			clock_gettime(CLOCK_MONOTONIC, &next);
+			add_microseconds(&next, period);
+		}
+		if (pthread_cond_timedwait(&timer_signal, &timer_lock, &next) != ETIMEDOUT){
+			continue;
+		}
+		raise_interrupt(timer_vector);
+		add_microseconds(&next, period);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if (time_before(&next, &now)){
+			next = now;
+			add_microseconds(&next, period);
+		}
+	}
+	if (active){
+		remove_event_source();
+	}
+	pthread_mutex_unlock(&timer_lock);
+	return NULL;
+}
+
+uint8_t start_timer(){
+	for (size_t i = 0;i<device_count;++i){
+		if (devices[i].type != DEV_TIMER){
+			continue;
+		}
+		pthread_condattr_t attr;
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_destroy(&timer_signal);
+		pthread_cond_init(&timer_signal, &attr);
+		pthread_condattr_destroy(&attr);
+		atomic_store(&timing, 1);
+		if (pthread_create(&timer_thread, NULL, run_timer, NULL) != 0){
+			atomic_store(&timing, 0);
+			return 0;
+		}
+		return 1;
+	}
+	return 1;
+}
+
+void stop_timer(){
+	if (atomic_exchange(&timing, 0)){
+		pthread_mutex_lock(&timer_lock);
+		pthread_cond_signal(&timer_signal);
+		pthread_mutex_unlock(&timer_lock);
+		pthread_join(timer_thread, NULL);
+	}
+}
+
+static atomic_uchar transferring;
+static pthread_t dma_thread;
+
+void* run_dma(void* arg){
+	pthread_mutex_lock(&dma_lock);
+	while (atomic_load(&transferring)){
+		if (!dma_pending){
+			pthread_cond_wait(&dma_signal, &dma_lock);
+			continue;
+		}
+		dma_transfer job = dma_job;
+		pthread_mutex_unlock(&dma_lock);
+		byte status = DMA_FAILED;
+		if (memory_range(job.src, job.len) && memory_range(job.dst, job.len)){
+			memmove(ram+job.dst, ram+job.src, job.len);
+			mark_dirty(job.dst, job.len);
+			status = DMA_DONE;
+		}
+		pthread_mutex_lock(&dma_lock);
+		dma_pending = 0;
+		__atomic_store_n(ram+job.dev->start+19, status, __ATOMIC_RELEASE);
+		if (job.interrupt){
+			raise_interrupt(job.vector);
+		}
+		remove_event_source();
+	}
+	pthread_mutex_unlock(&dma_lock);
+	return NULL;
+}
+
+uint8_t start_dma(){
+	for (size_t i = 0;i<device_count;++i){
+		if (devices[i].type != DEV_DMA){
+			continue;
+		}
+		atomic_store(&transferring, 1);
+		if (pthread_create(&dma_thread, NULL, run_dma, NULL) != 0){
+			atomic_store(&transferring, 0);
+			return 0;
+		}
+		return 1;
+	}
+	return 1;
+}
+
+void stop_dma(){
+	if (atomic_exchange(&transferring, 0)){
+		pthread_mutex_lock(&dma_lock);
+		pthread_cond_signal(&dma_signal);
+		pthread_mutex_unlock(&dma_lock);
+		pthread_join(dma_thread, NULL);
+	}
+}
+
+#ifndef HEADLESS
+
+#define FRAME_MS 16
+#define WINDOW_SIZE 512
+
+static atomic_uchar windowed;
+static uint8_t input_source;
+static pthread_t window_thread;
+
+void upload_dirty_rows(device* screen, SDL_Texture* texture){
+	word row = 0;
+	while (row < screen->height){
+		if (!atomic_exchange_explicit(&screen->dirty[row], 0, memory_order_acquire)){
+			row += 1;
+			continue;
+		}
+		word span = row+1;
+		while (span < screen->height && atomic_exchange_explicit(&screen->dirty[span], 0, memory_order_acquire)){
+			span += 1;
+		}
+		SDL_Rect rect = {0, row, screen->width, span-row};
+		SDL_UpdateTexture(texture, &rect, ram+screen->start+(row*screen->width), screen->width);
+		row = span;
+	}
+}
+
+void push_input(byte type, word event){
+	for (size_t i = 0;i<device_count;++i){
+		if (devices[i].type == type){
+			ring_push(&devices[i], event);
+		}
+	}
+}
+
+void handle_event(SDL_Event* event, device* screen){
+	int32_t x, y;
+	word buttons;
+	switch (event->type){
+	case SDL_KEYDOWN:
+	case SDL_KEYUP:
+		if (event->key.repeat){
+			break;
+		}
+		push_input(DEV_KEYBOARD, (event->key.keysym.sym & 0x7FFFFFFF) | ((word)(event->type == SDL_KEYDOWN) << 31));
+		break;
+	case SDL_MOUSEMOTION:
+	case SDL_MOUSEBUTTONDOWN:
+	case SDL_MOUSEBUTTONUP:
+		buttons = SDL_GetMouseState(&x, &y);
+		if (screen != NULL){
+			x = (x*(int32_t)screen->width)/WINDOW_SIZE;
+			y = (y*(int32_t)screen->height)/WINDOW_SIZE;
+		}
+		push_input(DEV_MOUSE, ((x & 0xFFF) << 20) | ((y & 0xFFF) << 8) | (buttons & 0xFF));
+		break;
+	}
+}
+
+void* run_window(void* arg){
+	device* screen = arg;
+	if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0){
+		printf("failed to start video: %s\n", SDL_GetError());
+		if (input_source){
+			remove_event_source();
+		}
+		return NULL;
+	}
+	SDL_Window* window = SDL_CreateWindow("VM", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WINDOW_SIZE, WINDOW_SIZE, 0);
+	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_PRESENTVSYNC);
+	SDL_Texture* texture = NULL;
+	if (screen != NULL){
+		texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB332, SDL_TEXTUREACCESS_STREAMING, screen->width, screen->height);
+	}
+	SDL_Event event;
+	while (atomic_load(&windowed)){
+		uint32_t frame = SDL_GetTicks();
+		while (SDL_PollEvent(&event)){
+			handle_event(&event, screen);
+		}
+		SDL_RenderClear(renderer);
+		if (texture != NULL){
+			upload_dirty_rows(screen, texture);
+			SDL_RenderCopy(renderer, texture, NULL, NULL);
+		}
+		SDL_RenderPresent(renderer);
+		uint32_t elapsed = SDL_GetTicks()-frame;
+		while (elapsed < FRAME_MS && SDL_WaitEventTimeout(&event, FRAME_MS-elapsed)){
+			handle_event(&event, screen);
+			elapsed = SDL_GetTicks()-frame;
+		}
+	}
+	if (texture != NULL){
+		SDL_DestroyTexture(texture);
+	}
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	SDL_QuitSubSystem(SDL_INIT_VIDEO);
+	SDL_Quit();
+	return NULL;
+}
+
+uint8_t start_window(){
+	device* screen = NULL;
+	uint8_t input = 0;
+	for (size_t i = 0;i<device_count;++i){
+		if (devices[i].type == DEV_SCREEN && devices[i].dirty != NULL && screen == NULL){
+			screen = &devices[i];
+		}
+		input |= (devices[i].type == DEV_KEYBOARD) || (devices[i].type == DEV_MOUSE);
+	}
+	if (screen == NULL && !input){
+		return 1;
+	}
+	if (screen != NULL){
+		for (word row = 0;row<screen->height;++row){
+			atomic_store(&screen->dirty[row], 1);
+		}
+	}
+	atomic_store(&windowed, 1);
+	input_source = input;
+	if (input){
+		atomic_fetch_add(&event_sources, 1);
+	}
+	if (pthread_create(&window_thread, NULL, run_window, screen) != 0){
+		atomic_store(&windowed, 0);
+		if (input){
+			remove_event_source();
+		}
+		return 0;
+	}
+	return 1;
+}
+
+void stop_window(){
+	if (atomic_exchange(&windowed, 0)){
+		pthread_join(window_thread, NULL);
+	}
+}
+
+#else
+
+uint8_t start_window(){
+	return 1;
 }
 
+void stop_window(){}
+
+#endif
+
 uint8_t run_rom_image(int32_t argc, char** argv){
 #if (DEBUG==1)
 	printf("symbols:\n");
 #endif
 	assert_return(setup_devices())
-	SDL_Window* window;
-	SDL_Renderer* renderer;
-	SDL_CreateWindowAndRenderer(512, 512, SDL_WINDOW_OPENGL, &window, &renderer);
-	SDL_SetWindowTitle(window, "VM");
-	SDL_Init(SDL_INIT_EVERYTHING);
 	assert_return(argc >= 3)
 	FILE* fd = fopen(argv[2], "rb");
 	assert_return(fd!=NULL)
@@ -1548,16 +4720,45 @@ uint8_t run_rom_image(int32_t argc, char** argv){
 	size_t size = fread(ram+PROG_ADDRESS, sizeof(byte), PROG_SIZE, fd);
 	assert_return(size < PROG_SIZE)
 	uint8_t debug = 0;
-	if (argc >= 4){
-		if (strcmp(argv[3], "-g")==0){
+	FILE* profile = NULL;
+	for (int32_t i = 3;i<argc;++i){
+		if (strcmp(argv[i], "-g")==0){
 			debug = 1;
 		}
+		else if (strcmp(argv[i], "-b")==0 && i+1<argc){
+			block_fd = open(argv[++i], O_RDWR);
+			assert_return(block_fd >= 0)
+		}
+		else if (strcmp(argv[i], "-p")==0 && i+1<argc){
+			profile = fopen(argv[++i], "w");
+			assert_return(profile!=NULL)
+		}
+		else if (strcmp(argv[i], "-l")==0 && i+1<argc){
+			assert_return(load_host_calls(argv[++i]))
+		}
+	}
+	if (block_device != NULL && block_fd >= 0){
+		assert_return(map_block(0) != 0)
+	}
+	assert_return(start_window())
+	assert_return(start_timer())
+	assert_return(start_dma())
+	run_rom(debug, profile!=NULL);
+	stop_io();
+	stop_dma();
+	stop_timer();
+	stop_window();
+	if (profile != NULL){
+		write_profile(profile);
+	}
+	if (block_fd >= 0){
+		if (block_device != NULL){
+			msync(ram+block_device->start, BLOCK_WINDOW, MS_SYNC);
+		}
+		close(block_fd);
 	}
-	run_rom(debug);
-	SDL_DestroyWindow(window);
-	SDL_DestroyRenderer(renderer);
-	SDL_Quit();
 	fclose(fd);
+	return 1;
 }
 
 int main(int32_t argc, char** argv){